@@ -0,0 +1,80 @@
+#ifndef TINYFM3_AUDIO_SINK_HPP
+#define TINYFM3_AUDIO_SINK_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <iterator>
+#include <algorithm>
+
+#include "spsc_ring.hpp"
+
+namespace tinyfm3 {
+  enum class sample_format {
+    pcm16,
+    float32
+  };
+  bool parse_sample_format( const std::string &name, sample_format &format );
+
+  class audio_sink {
+  public:
+    constexpr static size_t block_size = 16384u;
+    constexpr static size_t block_count = 16u;
+    audio_sink( const std::string &filename, sample_format format_ = sample_format::pcm16 );
+    audio_sink( const audio_sink& ) = delete;
+    audio_sink &operator=( const audio_sink& ) = delete;
+    ~audio_sink();
+    bool good() const { return !failed.load( std::memory_order_acquire ); }
+    void operator()( float value ) {
+      current[ filled++ ] = value;
+      if( filled == block_size ) submit();
+    }
+    template< typename Iterator >
+    void operator()( Iterator begin, Iterator end ) {
+      while( begin != end ) {
+        const size_t length = std::min( size_t( std::distance( begin, end ) ), block_size - filled );
+        std::copy( begin, std::next( begin, length ), std::next( current, filled ) );
+        std::advance( begin, length );
+        filled += length;
+        if( filled == block_size ) submit();
+      }
+    }
+    void operator()( const std::vector< float > &data ) {
+      ( *this )( data.begin(), data.end() );
+    }
+    void close();
+    size_t get_stall_count() const { return stall_count; }
+    double get_stall_time() const { return stall_time; }
+    void report( const std::string &name ) const;
+  private:
+    struct block {
+      float *data;
+      size_t size;
+    };
+    void submit();
+    void acquire();
+    void run();
+    bool write( const float *data, size_t size );
+    void *file;
+    int fd;
+    sample_format format;
+    std::unique_ptr< float, void(*)( void* ) > storage;
+    std::unique_ptr< int16_t, void(*)( void* ) > converted;
+    spsc_ring< block, block_count > filled_blocks;
+    spsc_ring< float*, block_count > free_blocks;
+    float *current;
+    size_t filled;
+    size_t stall_count;
+    double stall_time;
+    std::atomic< bool > closing;
+    std::atomic< bool > failed;
+    std::thread writer;
+  };
+}
+
+#endif
+
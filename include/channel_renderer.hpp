@@ -0,0 +1,131 @@
+#ifndef TINYFM3_CHANNEL_RENDERER_HPP
+#define TINYFM3_CHANNEL_RENDERER_HPP
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "common.hpp"
+#include "normalizer.hpp"
+#include "midi_sequencer2.hpp"
+
+namespace tinyfm3 {
+  template< typename Iterator >
+  class channel_renderer {
+  public:
+    channel_renderer( unsigned int group_count, unsigned int thread_count_ ) :
+      thread_count( std::max( 1u, std::min( thread_count_, group_count ) ) ),
+      generation( 0u ), finished( 0u ), block_size( 0u ), closing( false ) {
+      for( unsigned int i = 0u; i != group_count; ++i )
+        groups.emplace_back( new group );
+      for( unsigned int t = 1u; t < thread_count; ++t )
+        workers.emplace_back( [this,t]() { run( t ); } );
+    }
+    channel_renderer( const channel_renderer& ) = delete;
+    channel_renderer &operator=( const channel_renderer& ) = delete;
+    ~channel_renderer() {
+      {
+        std::lock_guard< std::mutex > lock( guard );
+        closing = true;
+      }
+      start.notify_all();
+      for( auto &worker: workers ) worker.join();
+    }
+    bool load( Iterator begin, Iterator end ) {
+      for( unsigned int i = 0u; i != groups.size(); ++i ) {
+        if( !groups[ i ]->seq.load( begin, end ) ) return false;
+        uint16_t mask = 0u;
+        for( unsigned int channel = i; channel < 16u; channel += groups.size() )
+          mask |= uint16_t( 1u << channel );
+        groups[ i ]->seq.get_player().set_channel_mask( mask );
+      }
+      return true;
+    }
+    bool is_end() {
+      return groups.front()->seq.is_end();
+    }
+    void operator()( size_t size ) {
+      if( thread_count != 1u ) {
+        {
+          std::lock_guard< std::mutex > lock( guard );
+          block_size = size;
+          finished = 0u;
+          ++generation;
+        }
+        start.notify_all();
+      }
+      render_share( 0u, size );
+      if( thread_count != 1u ) {
+        std::unique_lock< std::mutex > lock( guard );
+        done.wait( lock, [this]() { return finished == thread_count - 1u; } );
+      }
+      mixed.resize( size );
+      for( size_t i = 0u; i != size; ++i ) {
+        float output = 0.f;
+        float active_channels = 0.f;
+        for( const auto &g: groups ) {
+          output += g->output[ i ];
+          active_channels += g->level[ i ];
+        }
+        const float gain = norm( 1.f, active_channels );
+        mixed[ i ] = output * gain;
+        for( const auto &g: groups )
+          g->output[ i ] *= gain;
+      }
+    }
+    const std::vector< float > &get_mix() const { return mixed; }
+    const std::vector< float > &get_stem( unsigned int i ) const { return groups[ i ]->output; }
+    size_t get_group_count() const { return groups.size(); }
+  private:
+    void render_share( unsigned int t, size_t size ) {
+      for( size_t i = t; i < groups.size(); i += thread_count )
+        groups[ i ]->render( size );
+    }
+    void run( unsigned int t ) {
+      size_t seen = 0u;
+      while( true ) {
+        size_t size;
+        {
+          std::unique_lock< std::mutex > lock( guard );
+          start.wait( lock, [&]() { return closing || generation != seen; } );
+          if( closing ) return;
+          seen = generation;
+          size = block_size;
+        }
+        render_share( t, size );
+        {
+          std::lock_guard< std::mutex > lock( guard );
+          ++finished;
+        }
+        done.notify_one();
+      }
+    }
+    struct group {
+      void render( size_t size ) {
+        output.resize( size );
+        level.resize( size );
+        seq( output.begin(), output.end(), level.begin() );
+      }
+      midi_sequencer< Iterator > seq;
+      std::vector< float > output;
+      std::vector< float > level;
+    };
+    unsigned int thread_count;
+    std::vector< std::unique_ptr< group > > groups;
+    std::vector< float > mixed;
+    normalizer norm;
+    std::mutex guard;
+    std::condition_variable start;
+    std::condition_variable done;
+    size_t generation;
+    unsigned int finished;
+    size_t block_size;
+    bool closing;
+    std::vector< std::thread > workers;
+  };
+}
+
+#endif
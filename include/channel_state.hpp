@@ -5,7 +5,7 @@
 
 namespace tinyfm3 {
   struct channel_state {
-    channel_state( channel_t index_ ) : index( index_ ), modulation( 0 ), volume( 1 ), expression( 1 ), final_volume( 1 ), pitch_bend( 0 ), pitch_sensitivity( 1 ), final_pitch( 0 ), pan( 0 ) {}
+    channel_state( channel_t index_ ) : index( index_ ), modulation( 0 ), volume( 1 ), expression( 1 ), final_volume( 1 ), pitch_bend( 0 ), pitch_sensitivity( 1 ), final_pitch( 0 ), pan( 0 ), sustain( false ) {}
     void reset() {
       modulation = 0;
       volume = 1;
@@ -1,12 +1,20 @@
 #ifndef TINYFM3_COMMON_HPP
 #define TINYFM3_COMMON_HPP
 
+#include <cstdint>
+#include <cstddef>
+
+#ifndef TINYFM3_POLYPHONY
+#define TINYFM3_POLYPHONY 64
+#endif
+
 namespace tinyfm3 {
   struct invalid_configuration {};
   constexpr static size_t fm_operator_count = 4u;
   constexpr static size_t frequency = 44100u;
   constexpr static float delta = 1.f/44100.f;
-  constexpr static int polyphony_count = 16;
+  constexpr static int polyphony_count = TINYFM3_POLYPHONY;
+  static_assert( polyphony_count > 0 && polyphony_count <= 256, "TINYFM3_POLYPHONY must be between 1 and 256" );
   using slot_id_t = uint32_t;
   using scale_t = uint8_t;
   using channel_t = uint8_t;
@@ -3,10 +3,12 @@
 
 #include <array>
 #include <vector>
+#include <random>
 
 class dna {
 public:
   dna();
+  dna( std::mt19937 &random_generator );
   dna( const std::array< uint32_t, 56u > &src );
   dna( const dna& ) = default;
   dna( dna&& ) = default;
@@ -14,6 +16,7 @@ public:
   dna &operator=( dna&& ) = default;
   std::vector< float > operator()( float attack, float release, bool ) const;
   dna crossover( const dna &r, int mutation_rate ) const;
+  dna crossover( const dna &r, int mutation_rate, std::mt19937 &random_generator ) const;
   bool operator==( const dna &r ) const;
   bool operator!=( const dna &r ) const;
 private:
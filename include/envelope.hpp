@@ -3,7 +3,10 @@
 
 #include <cstdlib>
 #include <cstdint>
+#include <cmath>
 #include <iterator>
+#include <limits>
+#include <algorithm>
 
 #include "common.hpp"
 
@@ -63,6 +66,44 @@ namespace tinyfm3 {
     float sustain;
     float release;
   };
+  struct envelope_params {
+    constexpr static uint32_t infinite = std::numeric_limits< uint32_t >::max();
+    envelope_params() : sustain( 0 ), ksr_d( delta ), attack( 0 ), decay1( 0 ), decay2( 0 ), release( 0 ), delay_steps( 0u ), attack_steps( 0u ), hold_steps( 0u ), decay_steps( 0u ), sustain_steps( 1u ) {}
+    envelope_params( uint8_t key, const envelope_config &config ) {
+      reset( key, config );
+    }
+    void reset( uint8_t key, const envelope_config &config ) {
+      sustain = config.sustain;
+      ksr_d = ( key * config.ksr + 1.f ) * delta;
+      attack = config.attack * ksr_d;
+      decay1 = config.decay1 * ksr_d;
+      decay2 = config.decay2 * ksr_d;
+      release = config.release * ksr_d;
+      delay_steps = config.delay ? get_steps( config.delay, ksr_d ) : 0u;
+      attack_steps = config.attack ? get_steps( 1.f, attack ) : 0u;
+      hold_steps = config.hold ? get_steps( config.hold, ksr_d ) : 0u;
+      decay_steps = config.decay1 ? get_steps( 1.f - config.sustain, -decay1 ) : 0u;
+      sustain_steps = get_steps( config.sustain, -decay2 );
+    }
+    static uint32_t get_steps( float distance, float speed ) {
+      if( distance <= 0.f ) return 1u;
+      if( speed <= 0.f ) return infinite;
+      const double steps = std::ceil( double( distance ) / double( speed ) );
+      if( steps >= double( infinite ) ) return infinite;
+      return std::max( uint32_t( steps ), 1u );
+    }
+    float sustain;
+    float ksr_d;
+    float attack;
+    float decay1;
+    float decay2;
+    float release;
+    uint32_t delay_steps;
+    uint32_t attack_steps;
+    uint32_t hold_steps;
+    uint32_t decay_steps;
+    uint32_t sustain_steps;
+  };
   class envelope {
   public:
     enum class index_t {
@@ -75,134 +116,114 @@ namespace tinyfm3 {
       sustain = 6u,
       release = 7u,
     };
-    envelope() : config( nullptr ), advance_( &envelope::advance_inactive ) {}
+    constexpr static uint32_t infinite = envelope_params::infinite;
+    envelope() : playing( false ), start_level( 0 ), rate( 0 ), elapsed( 0u ), length( infinite ), end_( &envelope::end_inactive ) {}
     void reset() {
-      advance_ = &envelope::advance_inactive;
-      config = nullptr;
+      set_inactive();
+      playing = false;
     }
     float operator()() const {
-      return current_level;
-    }
-    void note_on( uint8_t key, const envelope_config *config_ ) {
-      config = config_;
-      ksr_d = ( key * config->ksr + 1.f ) * delta;
-      current_time = 0u;
-      current_level = 0u;
-      attack = config->attack * ksr_d;
-      decay1 = config->decay1 * ksr_d;
-      decay2 = config->decay2 * ksr_d;
-      if( config->delay )
-        advance_ = &envelope::advance_delay;
-      else if( config->attack )
-        advance_ = &envelope::advance_attack;
-      else if( config->hold ) {
-        current_level = 1.f;
-        advance_ = &envelope::advance_hold;
-      }
-      else if( config->decay1 ) {
-        current_level = 1.f;
-        advance_ = &envelope::advance_decay;
-      }
-      else {
-        current_level = config->sustain;
-        advance_ = &envelope::advance_sustain;
-      }
+      return start_level + rate * elapsed;
+    }
+    void note_on( uint8_t key, const envelope_config *config ) {
+      note_on( envelope_params( key, *config ) );
+    }
+    void note_on( const envelope_params &params_ ) {
+      params = params_;
+      playing = true;
+      if( params.delay_steps )
+        set_stage( 0.f, 0.f, params.delay_steps, &envelope::end_delay );
+      else
+        end_delay();
     }
     void note_off() {
-      if( config ) {
-        release = config->release * ksr_d;
-        advance_ = &envelope::advance_release;
+      if( playing ) {
+        const float level = ( *this )();
+        set_stage( level, params.release, envelope_params::get_steps( level, -params.release ), &envelope::end_release );
       }
     }
+    uint32_t get_remaining() const {
+      return ( length == infinite ) ? infinite : length - elapsed;
+    }
+    uint32_t fill( float *dest, uint32_t count ) {
+      const uint32_t run = std::min( count, get_remaining() );
+      for( uint32_t i = 0u; i != run; ++i )
+        dest[ i ] = start_level + rate * ( elapsed + i );
+      ( *this ) += run;
+      return run;
+    }
     void operator++() {
-      ( this ->* advance_ )( 1u );
+      if( ++elapsed == length )
+        ( this ->* end_ )();
     }
     void operator+=( uint32_t count ) {
-      ( this ->* advance_ )( count );
+      while( count ) {
+        const uint32_t run = std::min( count, length - elapsed );
+        elapsed += run;
+        count -= run;
+        if( elapsed == length )
+          ( this ->* end_ )();
+      }
     }
-    operator bool() const { return advance_ != &envelope::advance_inactive; }
+    operator bool() const { return end_ != &envelope::end_inactive; }
   private:
-    void advance_inactive( uint32_t ) {}
-    void advance_delay( uint32_t count ) {
-      current_time += ksr_d * count;
-      if( current_time >= config->delay ) {
-        if( config->attack )
-          advance_ = &envelope::advance_attack;
-        else if( config->hold ) {
-          current_time = 0.f;
-          current_level = 1.f;
-          advance_ = &envelope::advance_hold;
-        }
-        else if( config->decay1 ) {
-          current_level = 1.f;
-          advance_ = &envelope::advance_decay;
-        }
-        else {
-          current_level = config->sustain;
-          advance_ = &envelope::advance_sustain;
-        }
-      }
+    void set_stage( float start_level_, float rate_, uint32_t length_, void(envelope::*end)() ) {
+      start_level = start_level_;
+      rate = rate_;
+      elapsed = 0u;
+      length = length_;
+      end_ = ( length == infinite ) ? &envelope::end_steady : end;
     }
-    void advance_attack( uint32_t count ) {
-      current_level += attack * count;
-      if( current_level >= 1.f ) {
-        current_level = 1.f;
-        current_time = 0.f;
-        if( config->hold )
-          advance_ = &envelope::advance_hold;
-        else if( config->decay1 )
-          advance_ = &envelope::advance_decay;
-        else {
-          current_level = config->sustain;
-          advance_ = &envelope::advance_sustain;
-        }
-      }
+    void set_inactive() {
+      start_level = 0.f;
+      rate = 0.f;
+      elapsed = 0u;
+      length = infinite;
+      end_ = &envelope::end_inactive;
     }
-    void advance_hold( uint32_t count ) {
-      current_time += ksr_d * count;
-      if( current_time >= config->hold ) {
-        if( config->decay1 ) {
-          advance_ = &envelope::advance_decay;
-        }
-        else {
-          current_level = config->sustain;
-          advance_ = &envelope::advance_sustain;
-        }
-      }
+    void end_inactive() {
+      elapsed = 0u;
     }
-    void advance_decay( uint32_t count ) {
-      current_level += decay1 * count;
-      if( current_level <= config->sustain ) {
-        current_level = config->sustain;
-        advance_ = &envelope::advance_sustain;
-      }
+    void end_steady() {
+      start_level += rate * elapsed;
+      elapsed = 0u;
     }
-    void advance_sustain( uint32_t count ) {
-      current_level += decay2 * count;
-      if( current_level <= 0 ) {
-        current_level = 0;
-        advance_ = &envelope::advance_inactive;
-      }
+    void end_delay() {
+      if( params.attack_steps )
+        set_stage( 0.f, params.attack, params.attack_steps, &envelope::end_attack );
+      else
+        end_attack();
     }
-    void advance_release( uint32_t count ) {
-      current_level += release * count;
-      if( current_level <= 0 ) {
-        current_level = 0;
-        advance_ = &envelope::advance_inactive;
-        config = nullptr;
-      }
+    void end_attack() {
+      if( params.hold_steps )
+        set_stage( 1.f, 0.f, params.hold_steps, &envelope::end_hold );
+      else
+        end_hold();
     }
-    const envelope_config *config;
-    float current_time;
-    float current_level;
-    float ksr_d;
-    float attack;
-    float decay1;
-    float decay2;
-    float release;
-    void(envelope::*advance_)( uint32_t );
+    void end_hold() {
+      if( params.decay_steps )
+        set_stage( 1.f, params.decay1, params.decay_steps, &envelope::end_decay );
+      else
+        end_decay();
+    }
+    void end_decay() {
+      set_stage( params.sustain, params.decay2, params.sustain_steps, &envelope::end_sustain );
+    }
+    void end_sustain() {
+      set_inactive();
+    }
+    void end_release() {
+      set_inactive();
+      playing = false;
+    }
+    envelope_params params;
+    bool playing;
+    float start_level;
+    float rate;
+    uint32_t elapsed;
+    uint32_t length;
+    void(envelope::*end_)();
   };
 }
 
 #endif
-
@@ -1,6 +1,7 @@
 #ifndef WAV2IMAGE_FFT_H
 #define WAV2IMAGE_FFT_H
 
+#include <cmath>
 #include <cstdlib>
 #include <cstdint>
 #include <string>
@@ -9,6 +10,10 @@
 #include <memory>
 #include <boost/container/flat_map.hpp>
 
+#include "filterbank.hpp"
+#include "frame_table.hpp"
+#include "pixel_store.hpp"
+
 using window_list_t = boost::container::flat_map< unsigned int, std::shared_ptr< float > >;
 
 struct fft_failed : public std::runtime_error {
@@ -33,11 +38,20 @@ struct fft_data_transfar_failed : public fft_failed {
   fft_data_transfar_failed( const char *what ) : fft_failed( what ) {}
 };
 
-void init_fft();
+void init_fft( unsigned int thread_count = 4u );
 window_list_t generate_window();
 //std::shared_ptr< float > fft( const window_list_t &window, const std::vector< int16_t > &data, size_t resolution, size_t interval, size_t width );
-std::pair< std::vector< float >, std::shared_ptr< float > > fftref( const window_list_t &window, const std::vector< int16_t > &data, size_t resolution, float a, float b, size_t width );
-std::pair< float, std::vector< float > > fftcomp( const float*, size_t, const window_list_t &window, const std::vector< int16_t > &data, size_t resolution, float a, float b, size_t width );
+std::pair< std::vector< float >, std::shared_ptr< float > > fftref( const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width );
+std::pair< float, std::vector< float > > fftcomp( const tinyfm3::pixel_store &ref, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width );
+tinyfm3::pixel_store fftstore( const float *pixels, size_t batch_count, size_t width, tinyfm3::pixel_precision precision );
+std::shared_ptr< uint8_t > fftquantize( const float *pixels, size_t size );
+tinyfm3::pixel_store fftclone( const tinyfm3::pixel_store &store );
+std::shared_ptr< uint8_t > fftclone_levels( const uint8_t *levels, size_t size );
+std::pair< float, std::vector< float > > fftcomp_quantized( const uint8_t*, size_t, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width );
+std::vector< float > fftfetch( const float *pixels, size_t size );
+std::vector< float > fftproject( const float *pixels, size_t batch_count, const tinyfm3::filterbank &bank );
+std::pair< float, std::vector< float > > fftcomp_banded( const float*, size_t, const tinyfm3::filterbank &bank, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width );
+std::pair< float, std::vector< float > > fftcomp_banded_quantized( const uint8_t*, size_t, const tinyfm3::filterbank &bank, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width );
 
 
 #endif
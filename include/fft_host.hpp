@@ -0,0 +1,189 @@
+#ifndef TINYFM3_FFT_HOST_HPP
+#define TINYFM3_FFT_HOST_HPP
+
+#include <cmath>
+#include <vector>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <utility>
+#include <algorithm>
+
+#include "fft.hpp"
+#include "log_level.hpp"
+
+namespace tinyfm3 {
+  namespace host {
+    template< typename Transform >
+    Transform &get_transform( size_t resolution ) {
+      thread_local std::map< size_t, std::unique_ptr< Transform > > transforms;
+      auto &transform = transforms[ resolution ];
+      if( !transform ) transform.reset( new Transform( resolution ) );
+      return *transform;
+    }
+
+    inline const float *find_window( const window_list_t &window, size_t resolution ) {
+      const auto window_iter = window.find( resolution );
+      if( window_iter == window.end() ) throw fft_initialization_failed( "invalid resolution" );
+      return window_iter->second.get();
+    }
+
+    template< typename Transform >
+    std::pair< std::vector< float >, std::shared_ptr< float > > reference( const window_list_t &window, const frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+      const float *w = find_window( window, frames.get_resolution() );
+      const size_t batch = frames.get_batch_count( data.size() );
+      Transform &transform = get_transform< Transform >( frames.get_resolution() );
+      std::vector< float > envelope;
+      std::shared_ptr< float > pixels( new float[ batch * width ], []( float *p ) { delete[] p; } );
+      for( size_t current_batch = 0u; current_batch != batch; ++current_batch ) {
+        float *row = pixels.get() + current_batch * width;
+        frames( w, data.data(), data.size(), current_batch, transform.get_input() );
+        transform( row, width );
+        envelope.push_back( std::accumulate( row, row + width, 0.f ) );
+      }
+      return std::make_pair( std::move( envelope ), pixels );
+    }
+
+    template< typename Transform, typename CompareRow, typename LackingRow >
+    std::pair< float, std::vector< float > > compare_frames( size_t batch_count, const window_list_t &window, const frame_table &frames, const std::vector< int16_t > &data, size_t width, CompareRow compare_row, LackingRow lacking_row ) {
+      const float *w = find_window( window, frames.get_resolution() );
+      const size_t batch = frames.get_batch_count( data.size() );
+      Transform &transform = get_transform< Transform >( frames.get_resolution() );
+      std::vector< float > envelope;
+      std::vector< float > values( width );
+      double diff = 0.0;
+      for( size_t current_batch = 0u; current_batch != batch; ++current_batch ) {
+        frames( w, data.data(), data.size(), current_batch, transform.get_input() );
+        transform( values.data(), width );
+        diff += compare_row( values.data(), current_batch );
+        envelope.push_back( std::accumulate( values.begin(), values.end(), 0.f ) );
+      }
+      for( size_t current_batch = batch; current_batch < batch_count; ++current_batch )
+        diff += lacking_row( current_batch );
+      return std::make_pair( float( diff ), std::move( envelope ) );
+    }
+
+    template< typename Transform >
+    std::pair< float, std::vector< float > > compare( const pixel_store &ref, const window_list_t &window, const frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+      const size_t batch_count = ref.get_height();
+      return compare_frames< Transform >( batch_count, window, frames, data, width,
+        [&]( const float *values, size_t row ) -> double {
+          if( row < batch_count ) return ref.distance( values, row );
+          else return std::accumulate( values, values + width, 0.f );
+        },
+        [&]( size_t row ) -> double {
+          return ref.sum( row );
+        }
+      );
+    }
+
+    template< typename Transform >
+    std::pair< float, std::vector< float > > compare_quantized( const uint8_t *ref, size_t batch_count, const window_list_t &window, const frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+      const auto &quantize = log_level::get();
+      std::vector< uint8_t > levels( width );
+      return compare_frames< Transform >( batch_count, window, frames, data, width,
+        [&]( const float *values, size_t row ) -> double {
+          quantize( values, values + width, levels.data() );
+          if( row < batch_count ) return sad( levels.data(), ref + row * width, width );
+          else return sum_levels( levels.data(), width );
+        },
+        [&]( size_t row ) -> double {
+          return sum_levels( ref + row * width, width );
+        }
+      );
+    }
+
+    template< typename Transform >
+    std::pair< float, std::vector< float > > compare_banded( const float *ref, size_t batch_count, const filterbank &bank, const window_list_t &window, const frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+      const size_t band_count = bank.get_band_count();
+      std::vector< float > bands( band_count );
+      return compare_frames< Transform >( batch_count, window, frames, data, width,
+        [&]( const float *values, size_t row ) -> double {
+          bank( values, bands.data() );
+          float diff = 0.f;
+          if( row < batch_count ) {
+            const float *r = ref + row * band_count;
+            for( size_t i = 0u; i != band_count; ++i )
+              diff += std::abs( bands[ i ] - r[ i ] );
+          }
+          else {
+            for( size_t i = 0u; i != band_count; ++i )
+              diff += bands[ i ];
+          }
+          return diff;
+        },
+        [&]( size_t row ) -> double {
+          const float *r = ref + row * band_count;
+          return std::accumulate( r, r + band_count, 0.f );
+        }
+      );
+    }
+
+    template< typename Transform >
+    std::pair< float, std::vector< float > > compare_banded_quantized( const uint8_t *ref, size_t batch_count, const filterbank &bank, const window_list_t &window, const frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+      const auto &quantize = log_level::get();
+      const size_t band_count = bank.get_band_count();
+      std::vector< float > bands( band_count );
+      std::vector< uint8_t > levels( band_count );
+      return compare_frames< Transform >( batch_count, window, frames, data, width,
+        [&]( const float *values, size_t row ) -> double {
+          bank( values, bands.data() );
+          quantize( bands.data(), bands.data() + band_count, levels.data() );
+          if( row < batch_count ) return sad( levels.data(), ref + row * band_count, band_count );
+          else return sum_levels( levels.data(), band_count );
+        },
+        [&]( size_t row ) -> double {
+          return sum_levels( ref + row * band_count, band_count );
+        }
+      );
+    }
+
+    inline pixel_store store( const float *pixels, size_t batch_count, size_t width, pixel_precision precision ) {
+      auto store = pixel_store::create( pixels, width, batch_count, precision );
+      if( store.empty() ) throw fft_allocation_failed( "unable to allocate memory for reference" );
+      return store;
+    }
+
+    inline pixel_store clone( const pixel_store &source ) {
+      auto store = source.clone();
+      if( store.empty() && !source.empty() ) throw fft_allocation_failed( "unable to allocate memory for reference" );
+      return store;
+    }
+
+    inline std::shared_ptr< uint8_t > clone_levels( const uint8_t *source, size_t size ) {
+      std::shared_ptr< uint8_t > levels( new uint8_t[ size ], []( uint8_t *p ) { delete[] p; } );
+      std::copy( source, source + size, levels.get() );
+      return levels;
+    }
+
+    inline std::shared_ptr< uint8_t > quantize( const float *pixels, size_t size ) {
+      std::shared_ptr< uint8_t > levels( new uint8_t[ size ], []( uint8_t *p ) { delete[] p; } );
+      log_level::get()( pixels, pixels + size, levels.get() );
+      return levels;
+    }
+
+    inline std::vector< float > fetch( const float *pixels, size_t size ) {
+      return std::vector< float >( pixels, pixels + size );
+    }
+
+    inline std::vector< float > project( const float *pixels, size_t batch_count, const filterbank &bank ) {
+      std::vector< float > bands( batch_count * bank.get_band_count() );
+      bank( pixels, bands.data(), batch_count );
+      return bands;
+    }
+
+    inline window_list_t generate_window() {
+      window_list_t result;
+      for( unsigned int i = 16u; i != 65536u; i <<= 1 ) {
+        std::shared_ptr< float > w( new float[ i ], []( float *p ) { delete[] p; } );
+        for( unsigned int j = 0u; j != i; ++j )
+          w.get()[ j ] = sinf( float( M_PI ) * float( j ) / i ) / 32767.f;
+        result.insert( result.end(), std::make_pair( i, std::move( w ) ) );
+      }
+      return result;
+    }
+  }
+}
+
+#endif
+
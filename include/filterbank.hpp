@@ -0,0 +1,100 @@
+#ifndef TINYFM3_FILTERBANK_HPP
+#define TINYFM3_FILTERBANK_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace tinyfm3 {
+  enum class band_scale {
+    linear,
+    mel,
+    erb
+  };
+
+  inline bool parse_band_scale( const std::string &name, band_scale &scale ) {
+    if( name == "linear" ) scale = band_scale::linear;
+    else if( name == "mel" ) scale = band_scale::mel;
+    else if( name == "erb" ) scale = band_scale::erb;
+    else return false;
+    return true;
+  }
+
+  class filterbank {
+  public:
+    filterbank( band_scale scale_, size_t band_count, size_t width_, uint32_t resolution, uint32_t sample_rate ) : scale( scale_ ), width( width_ ) {
+      band_count = std::max( std::min( band_count, width ), size_t( 1u ) );
+      const float bin_width = float( sample_rate ) / float( resolution );
+      const float low = to_scale( 0.f );
+      const float high = to_scale( float( width - 1u ) * bin_width );
+      std::vector< float > edges( band_count + 2u );
+      for( size_t i = 0u; i != edges.size(); ++i )
+        edges[ i ] = from_scale( low + ( high - low ) * float( i ) / float( band_count + 1u ) ) / bin_width;
+      offsets.push_back( 0u );
+      for( size_t band = 0u; band != band_count; ++band ) {
+        const float left = edges[ band ];
+        const float center = edges[ band + 1u ];
+        const float right = edges[ band + 2u ];
+        const size_t first = size_t( std::ceil( left ) );
+        const size_t last = std::min( size_t( std::floor( right ) ), width - 1u );
+        size_t begin = first;
+        std::vector< float > w;
+        for( size_t bin = first; bin <= last; ++bin ) {
+          const float x = float( bin );
+          const float weight = ( x < center ) ? ( x - left ) / ( center - left ) : ( right - x ) / ( right - center );
+          if( weight <= 0.f ) {
+            if( w.empty() ) ++begin;
+            continue;
+          }
+          w.resize( bin - begin );
+          w.push_back( weight );
+        }
+        if( w.empty() ) {
+          begin = std::min( size_t( std::round( center ) ), width - 1u );
+          w.push_back( 1.f );
+        }
+        begins.push_back( uint32_t( begin ) );
+        weights.insert( weights.end(), w.begin(), w.end() );
+        offsets.push_back( uint32_t( weights.size() ) );
+      }
+    }
+    void operator()( const float *bins, float *bands ) const {
+      for( size_t band = 0u; band != begins.size(); ++band ) {
+        const float *b = bins + begins[ band ];
+        float sum = 0.f;
+        for( uint32_t i = offsets[ band ]; i != offsets[ band + 1u ]; ++i, ++b )
+          sum += weights[ i ] * *b;
+        bands[ band ] = sum;
+      }
+    }
+    void operator()( const float *bins, float *bands, size_t frame_count ) const {
+      for( size_t frame = 0u; frame != frame_count; ++frame )
+        ( *this )( bins + frame * width, bands + frame * begins.size() );
+    }
+    size_t get_band_count() const { return begins.size(); }
+    size_t get_width() const { return width; }
+    band_scale get_scale() const { return scale; }
+  private:
+    float to_scale( float f ) const {
+      if( scale == band_scale::mel ) return 2595.f * std::log10( 1.f + f / 700.f );
+      else if( scale == band_scale::erb ) return 21.4f * std::log10( 1.f + 0.00437f * f );
+      else return f;
+    }
+    float from_scale( float v ) const {
+      if( scale == band_scale::mel ) return 700.f * ( std::pow( 10.f, v / 2595.f ) - 1.f );
+      else if( scale == band_scale::erb ) return ( std::pow( 10.f, v / 21.4f ) - 1.f ) / 0.00437f;
+      else return v;
+    }
+    band_scale scale;
+    size_t width;
+    std::vector< uint32_t > begins;
+    std::vector< uint32_t > offsets;
+    std::vector< float > weights;
+  };
+}
+
+#endif
+
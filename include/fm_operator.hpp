@@ -5,6 +5,8 @@
 #include <cstdint>
 #include <array>
 #include <algorithm>
+#include <numeric>
+#include <cmath>
 
 #include "common.hpp"
 #include "envelope.hpp"
@@ -98,15 +100,16 @@ namespace tinyfm3 {
       config = config_;
       tone_clock_grad_d = uint32_t( freq * delta * config->freq * 0x80000000 );
       tone_clock = 0;
-      if( config->func == 0u ) generator = &fm_operator::sine;
-      else if( config->func == 1u ) generator = &fm_operator::noize;
-      else if( config->func == 2u ) generator = &fm_operator::triangle;
-      else if( config->func == 3u ) generator = &fm_operator::rect;
-      else if( config->func == 4u ) generator = &fm_operator::saw;
-      else if( config->func == 5u ) generator = &fm_operator::half;
-      else generator = &fm_operator::sine;
+      generator = get_generator( config->func );
       env.note_on( scale, &config->env );
     }
+    void note_on( float phase_rate, const fm_operator_config *config_, const envelope_params &env_params ) {
+      config = config_;
+      tone_clock_grad_d = uint32_t( phase_rate );
+      tone_clock = 0;
+      generator = get_generator( config->func );
+      env.note_on( env_params );
+    }
     void note_off() {
       env.note_off();
     }
@@ -120,6 +123,10 @@ namespace tinyfm3 {
       ++env;
       tone_clock += tone_clock_grad_d;
     }
+    void operator+=( uint32_t count ) {
+      env += count;
+      tone_clock += tone_clock_grad_d * count;
+    }
     operator bool() const {
       return env;
     }
@@ -130,6 +137,15 @@ namespace tinyfm3 {
     uint32_t tone_clock;
     float ( fm_operator::*generator )( float );
   private:
+    static float ( fm_operator::*get_generator( uint32_t func ) )( float ) {
+      if( func == 0u ) return &fm_operator::sine;
+      else if( func == 1u ) return &fm_operator::noize;
+      else if( func == 2u ) return &fm_operator::triangle;
+      else if( func == 3u ) return &fm_operator::rect;
+      else if( func == 4u ) return &fm_operator::saw;
+      else if( func == 5u ) return &fm_operator::half;
+      else return &fm_operator::sine;
+    }
     float sine( float drift ) {
 //#ifdef DISABLE_SINE_TABLE
       return sin( 2.0 * M_PI * ( tone_clock/double( 0x80000000 ) + drift )  ) * env();
@@ -246,9 +262,24 @@ namespace tinyfm3 {
     std::array< fm_operator_config, 4u > oper;
   };
 
+  struct key_voice {
+    template< typename Iterator >
+    void reset( uint8_t key, Iterator begin, Iterator end ) {
+      config.reset( begin, end );
+      const float freq = exp2f( ( ( float( key ) + 0.f + 3.f ) / 12.f ) ) * 6.875f;
+      for( size_t i = 0u; i != 4u; ++i ) {
+        env[ i ].reset( key, config.oper[ i ].env );
+        phase_rate[ i ] = freq * delta * config.oper[ i ].freq * 0x80000000;
+      }
+    }
+    fm_config config;
+    std::array< envelope_params, 4u > env;
+    std::array< float, 4u > phase_rate;
+  };
+
   class fm {
   public:
-    fm() : config( nullptr ), calc( &fm::inactive ), advance( &fm::advance_inactive ) {}
+    fm() : config( nullptr ), cs( nullptr ), calc( &fm::inactive ), advance( &fm::advance_inactive ) {}
     float operator()() { return (this->*calc)(); }
     void note_on( uint8_t scale_, float velocity_, const fm_config *config_, const channel_state *cs_ ) {
       scale = scale_;
@@ -262,6 +293,18 @@ namespace tinyfm3 {
       for( size_t i = 0u; i != 4u; ++i )
         oper[ i ].note_on( scale, freq, &config->oper[ i ] );
     }
+    void note_on( uint8_t scale_, float velocity_, const key_voice *voice, const channel_state *cs_ ) {
+      scale = scale_;
+      config = &voice->config;
+      cs = cs_;
+      std::fill( sample_level.begin(), sample_level.end(), 0 );
+      calc = &fm::active;
+      advance = &fm::advance_active;
+      const float bend = ( cs->final_pitch != 0.f ) ? exp2f( cs->final_pitch / 12.f ) : 1.f;
+      velocity = velocity_ * cs->final_volume;
+      for( size_t i = 0u; i != 4u; ++i )
+        oper[ i ].note_on( voice->phase_rate[ i ] * bend, &config->oper[ i ], voice->env[ i ] );
+    }
     void note_off() {
       for( auto &op: oper )
         op.note_off();
@@ -272,9 +315,27 @@ namespace tinyfm3 {
         op.pitch_bend( freq );
     }
     void operator++() { (this->*advance)(); }
+    void operator+=( uint32_t count ) {
+      if( !config ) return;
+      for( auto &op: oper )
+        op += count;
+      std::fill( sample_level.begin(), sample_level.end(), 0 );
+      if( !( oper[ 0 ] || oper[ 1 ] || oper[ 2 ] || oper[ 3 ] ) )
+        reset();
+    }
+    void rebind( const channel_state *channels ) {
+      if( cs ) cs = &channels[ cs->index ];
+    }
     operator bool() const {
       return oper[ 0 ] || oper[ 1 ] || oper[ 2 ] || oper[ 3 ];
     }
+    float get_amplitude() const {
+      if( !config ) return 0;
+      float level = 0;
+      for( uint32_t i = 0u; i != 4u; ++i )
+        level += config->mixer[ i ] * oper[ i ].env();
+      return level * velocity;
+    }
     float get_level() const {
       if( oper[ 0 ] || oper[ 1 ] || oper[ 2 ] || oper[ 3 ] )
         return velocity;
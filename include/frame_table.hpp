@@ -0,0 +1,58 @@
+#ifndef TINYFM3_FRAME_TABLE_HPP
+#define TINYFM3_FRAME_TABLE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+
+namespace tinyfm3 {
+  class frame_table {
+  public:
+    frame_table() : resolution( 0u ), a( 1.f ), b( 0.f ) {}
+    frame_table( size_t resolution_, float a_, float b_, size_t max_length ) : resolution( resolution_ ), a( a_ ), b( b_ ) {
+      for( size_t frame = 0u; ; ++frame ) {
+        const size_t offset = get_raw_offset( frame );
+        offsets.push_back( offset );
+        if( offset + resolution > max_length ) break;
+      }
+    }
+    size_t get_batch_count( size_t length ) const {
+      if( length < resolution ) return 1u;
+      const size_t c = length - resolution;
+      if( c >= offsets.back() ) {
+        const float x = ( -b + sqrtf( b*b + 4.f * a * float( c ) ) ) / ( 2.f * a );
+        return size_t( x ) == 0u ? 1u : size_t( x );
+      }
+      const size_t count = std::distance( std::next( offsets.begin() ), std::upper_bound( std::next( offsets.begin() ), offsets.end(), c ) );
+      return count == 0u ? 1u : count;
+    }
+    size_t get_offset( size_t frame ) const {
+      return frame < offsets.size() ? offsets[ frame ] : get_raw_offset( frame );
+    }
+    void operator()( const float *window, const int16_t *data, size_t length, size_t frame, float *dest ) const {
+      const size_t offset = get_offset( frame );
+      const size_t available = offset < length ? std::min( resolution, length - offset ) : 0u;
+      const int16_t *src = data + offset;
+      for( size_t i = 0u; i != available; ++i )
+        dest[ i ] = float( src[ i ] ) * window[ i ];
+      std::fill( dest + available, dest + resolution, 0.f );
+    }
+    size_t get_resolution() const { return resolution; }
+    float get_a() const { return a; }
+    float get_b() const { return b; }
+  private:
+    size_t get_raw_offset( size_t frame ) const {
+      return size_t( frame * frame * a + frame * b );
+    }
+    size_t resolution;
+    float a;
+    float b;
+    std::vector< size_t > offsets;
+  };
+}
+
+#endif
+
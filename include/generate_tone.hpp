@@ -5,7 +5,10 @@
 #include <vector>
 
 std::vector< int16_t > generate_tone(
-  int note, int delay, int release, int total_length, const std::vector< float > &config, bool
+  int note, int delay, int release, int total_length, const std::vector< float > &config, bool, float velocity = 1.f
+);
+std::vector< int16_t > generate_tone(
+  int note, int delay, int release, int total_length, const float *config_begin, const float *config_end, bool, float velocity = 1.f
 );
 
 #endif
@@ -0,0 +1,198 @@
+#ifndef TINYFM3_GENOME_SCHEMA_HPP
+#define TINYFM3_GENOME_SCHEMA_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <array>
+#include <string>
+#include <limits>
+#include <exception>
+#include <iterator>
+#include <algorithm>
+
+namespace tinyfm3 {
+  enum class gene_scale {
+    linear,
+    exp2,
+    release,
+    choice
+  };
+
+  enum class gene_encoding {
+    binary,
+    gray
+  };
+
+  struct gene_spec {
+    const char *name;
+    uint8_t field;
+    gene_scale scale;
+    float low;
+    float high;
+    uint32_t init_and;
+    uint32_t init_or;
+    gene_encoding encoding;
+    bool locked;
+    float constant;
+  };
+
+  constexpr gene_spec make_gene( const char *name, uint8_t field, gene_scale scale, float low, float high, uint32_t init_and = 0xFFFFFFFFu, uint32_t init_or = 0u ) {
+    return gene_spec{ name, field, scale, low, high, init_and, init_or, gene_encoding::binary, false, 0.f };
+  }
+
+  constexpr size_t genome_size = 56u;
+  constexpr size_t config_size = 70u;
+
+  constexpr std::array< gene_spec, genome_size > default_genome{{
+    make_gene( "mix0", 0u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "mix1", 1u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "mix2", 2u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "mix3", 3u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm0.freq", 6u, gene_scale::exp2, -4.f, 4.f, 0xFFFFFFFFu, 0xC0000000u ),
+    make_gene( "fm0.delay", 9u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm0.attack", 10u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm0.hold", 11u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm0.decay1", 12u, gene_scale::linear, 0.f, 4.f ),
+    make_gene( "fm0.decay2", 13u, gene_scale::linear, 0.f, 4.f ),
+    make_gene( "fm0.sustain", 14u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm0.release", 15u, gene_scale::release, 0.f, 2.f ),
+    make_gene( "fm0.fm0", 16u, gene_scale::linear, 0.f, 0.4f ),
+    make_gene( "fm0.fm1", 17u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm0.fm2", 18u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm0.fm3", 19u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm0.func", 21u, gene_scale::choice, 0.f, 5.f ),
+    make_gene( "fm1.freq", 22u, gene_scale::exp2, -4.f, 4.f, 0xFFFFFFFFu, 0xC0000000u ),
+    make_gene( "fm1.delay", 25u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm1.attack", 26u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm1.hold", 27u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm1.decay1", 28u, gene_scale::linear, 0.f, 4.f ),
+    make_gene( "fm1.decay2", 29u, gene_scale::linear, 0.f, 4.f ),
+    make_gene( "fm1.sustain", 30u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm1.release", 31u, gene_scale::release, 0.f, 2.f ),
+    make_gene( "fm1.fm0", 32u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm1.fm1", 33u, gene_scale::linear, 0.f, 0.4f ),
+    make_gene( "fm1.fm2", 34u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm1.fm3", 35u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm1.func", 37u, gene_scale::choice, 0.f, 5.f ),
+    make_gene( "fm2.freq", 38u, gene_scale::exp2, -4.f, 4.f, 0xFFFFFFFFu, 0xC0000000u ),
+    make_gene( "fm2.delay", 41u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm2.attack", 42u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm2.hold", 43u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm2.decay1", 44u, gene_scale::linear, 0.f, 4.f ),
+    make_gene( "fm2.decay2", 45u, gene_scale::linear, 0.f, 4.f ),
+    make_gene( "fm2.sustain", 46u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm2.release", 47u, gene_scale::release, 0.f, 2.f ),
+    make_gene( "fm2.fm0", 48u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm2.fm1", 49u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm2.fm2", 50u, gene_scale::linear, 0.f, 0.4f ),
+    make_gene( "fm2.fm3", 51u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm2.func", 53u, gene_scale::choice, 0.f, 5.f ),
+    make_gene( "fm3.freq", 54u, gene_scale::exp2, -4.f, 4.f, 0u, 0x80000000u ),
+    make_gene( "fm3.delay", 57u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm3.attack", 58u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm3.hold", 59u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm3.decay1", 60u, gene_scale::linear, 0.f, 4.f ),
+    make_gene( "fm3.decay2", 61u, gene_scale::linear, 0.f, 4.f ),
+    make_gene( "fm3.sustain", 62u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm3.release", 63u, gene_scale::release, 0.f, 2.f ),
+    make_gene( "fm3.fm0", 64u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm3.fm1", 65u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm3.fm2", 66u, gene_scale::linear, 0.f, 1.f ),
+    make_gene( "fm3.fm3", 67u, gene_scale::linear, 0.f, 0.4f ),
+    make_gene( "fm3.func", 69u, gene_scale::choice, 0.f, 5.f )
+  }};
+
+  inline uint32_t encode_gene( gene_encoding encoding, uint32_t value ) {
+    return encoding == gene_encoding::gray ? value ^ ( value >> 1 ) : value;
+  }
+
+  inline uint32_t decode_gene( gene_encoding encoding, uint32_t value ) {
+    if( encoding == gene_encoding::gray ) {
+      value ^= value >> 1;
+      value ^= value >> 2;
+      value ^= value >> 4;
+      value ^= value >> 8;
+      value ^= value >> 16;
+    }
+    return value;
+  }
+
+  class genome_schema {
+  public:
+    genome_schema() : genes( default_genome ) {}
+    const gene_spec &operator[]( size_t i ) const { return genes[ i ]; }
+    size_t size() const { return genes.size(); }
+    size_t find( const std::string &name ) const {
+      for( size_t i = 0u; i != genes.size(); ++i )
+        if( name == genes[ i ].name ) return i;
+      return genes.size();
+    }
+    bool lock( const std::string &name, float value ) {
+      const size_t i = find( name );
+      if( i == genes.size() ) return false;
+      genes[ i ].locked = true;
+      genes[ i ].constant = value;
+      return true;
+    }
+    bool lock( const std::string &serialized ) {
+      size_t pos = 0u;
+      while( pos < serialized.size() ) {
+        size_t next = serialized.find( ',', pos );
+        if( next == std::string::npos ) next = serialized.size();
+        const std::string item = serialized.substr( pos, next - pos );
+        const size_t equal = item.find( '=' );
+        if( equal == std::string::npos ) return false;
+        try {
+          if( !lock( item.substr( 0u, equal ), std::stof( item.substr( equal + 1u ) ) ) ) return false;
+        } catch( const std::exception& ) {
+          return false;
+        }
+        pos = next + 1u;
+      }
+      return true;
+    }
+    void encode( const float *config, float release, bool has_release, uint32_t *genome ) const {
+      std::array< float, config_size > scale;
+      scale.fill( 1.f );
+      for( size_t oper = 0u; oper != 4u; ++oper ) {
+        const size_t field = 16u + 16u * oper;
+        float sum = 0.f;
+        float limit = 1.f;
+        for( size_t k = field; k != field + 4u; ++k ) {
+          sum += config[ k ];
+          for( const auto &gene: genes )
+            if( gene.field == k && config[ k ] > 0.f ) limit = std::min( limit, gene.high / ( 1.5f * config[ k ] ) );
+        }
+        const float s = sum * 1.5f <= 1.f + 1.0e-4f ? 1.5f * limit : 1.5f;
+        std::fill( std::next( scale.begin(), field ), std::next( scale.begin(), field + 4u ), s );
+      }
+      for( size_t i = 0u; i != genes.size(); ++i ) {
+        const auto &gene = genes[ i ];
+        if( gene.locked ) {
+          genome[ i ] = 0u;
+          continue;
+        }
+        float value = config[ gene.field ] * scale[ gene.field ];
+        if( gene.scale == gene_scale::choice ) {
+          const float choice = std::min( std::max( std::round( value ), 0.f ), gene.high - 1.f );
+          genome[ i ] = encode_gene( gene.encoding, uint32_t( choice ) << 24 );
+          continue;
+        }
+        if( gene.scale == gene_scale::exp2 ) value = value > 0.f ? std::log2( value ) : gene.low;
+        else if( gene.scale == gene_scale::release ) value = ( has_release && release > 0.f ) ? value / release : ( gene.low + gene.high ) * 0.5f;
+        const double u = std::min( std::max( double( value - gene.low ) / double( gene.high - gene.low ), 0.0 ), 1.0 );
+        genome[ i ] = encode_gene( gene.encoding, uint32_t( u * std::numeric_limits< uint32_t >::max() ) );
+      }
+    }
+    void set_encoding( gene_encoding encoding ) {
+      for( auto &gene: genes )
+        if( gene.scale != gene_scale::choice ) gene.encoding = encoding;
+    }
+  private:
+    std::array< gene_spec, genome_size > genes;
+  };
+}
+
+#endif
+
@@ -2,10 +2,11 @@
 #define WAV2IMAGE_LOAD_MONORAL_H
 
 #include <cstdint>
+#include <cstddef>
 #include <string>
 #include <vector>
 
-std::vector< int16_t > load_monoral( const std::string &filename );
+std::vector< int16_t > load_monoral( const std::string &filename, size_t resample_taps = 32u );
 
 #endif
 
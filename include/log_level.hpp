@@ -0,0 +1,110 @@
+#ifndef TINYFM3_LOG_LEVEL_HPP
+#define TINYFM3_LOG_LEVEL_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <array>
+#include <limits>
+#include <iterator>
+#include <algorithm>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace tinyfm3 {
+  class log_level {
+  public:
+    log_level() {
+      thresholds[ 0 ] = 0.f;
+      for( unsigned int level = 1u; level != 256u; ++level ) {
+        uint32_t low = get_bits( 1.f );
+        uint32_t high = get_bits( std::numeric_limits< float >::max() );
+        if( get_level( get_float( high ) ) < level ) {
+          thresholds[ level ] = std::numeric_limits< float >::infinity();
+          continue;
+        }
+        while( low < high ) {
+          const uint32_t mid = low + ( high - low ) / 2u;
+          if( get_level( get_float( mid ) ) >= level ) high = mid;
+          else low = mid + 1u;
+        }
+        thresholds[ level ] = get_float( low );
+      }
+      thresholds[ 256 ] = std::numeric_limits< float >::infinity();
+      for( uint32_t i = 0u; i != table.size(); ++i ) {
+        const float lower = get_float( i << 16 );
+        table[ i ] = uint8_t( std::distance( std::next( thresholds.begin() ), std::upper_bound( std::next( thresholds.begin() ), std::prev( thresholds.end() ), lower ) ) );
+      }
+    }
+    uint8_t operator()( float l ) const {
+      const uint8_t p = table[ ( get_bits( l ) >> 16 ) & 0x7FFFu ];
+      return p + ( l >= thresholds[ p + 1u ] );
+    }
+    void operator()( const float *begin, const float *end, uint8_t *dest ) const {
+      for( ; begin != end; ++begin, ++dest )
+        *dest = ( *this )( *begin );
+    }
+    static uint8_t get_level( float l ) {
+      return uint8_t( std::min( std::max( 80.f * std::log10( std::max( l, 1.f ) ), 0.f ), 255.f ) );
+    }
+    static const log_level &get() {
+      static const log_level instance;
+      return instance;
+    }
+  private:
+    static uint32_t get_bits( float v ) {
+      uint32_t bits;
+      std::memcpy( &bits, &v, sizeof( bits ) );
+      return bits;
+    }
+    static float get_float( uint32_t bits ) {
+      float v;
+      std::memcpy( &v, &bits, sizeof( v ) );
+      return v;
+    }
+    std::array< float, 257u > thresholds;
+    std::array< uint8_t, 32768u > table;
+  };
+
+  inline uint64_t sad( const uint8_t *l, const uint8_t *r, size_t size ) {
+    uint64_t sum = 0u;
+    size_t i = 0u;
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    for( ; i + 32u <= size; i += 32u )
+      acc = _mm256_add_epi64( acc, _mm256_sad_epu8(
+        _mm256_loadu_si256( reinterpret_cast< const __m256i* >( l + i ) ),
+        _mm256_loadu_si256( reinterpret_cast< const __m256i* >( r + i ) )
+      ) );
+    alignas( 32 ) std::array< uint64_t, 4u > lanes;
+    _mm256_store_si256( reinterpret_cast< __m256i* >( lanes.data() ), acc );
+    sum += lanes[ 0 ] + lanes[ 1 ] + lanes[ 2 ] + lanes[ 3 ];
+#endif
+#if defined(__SSE2__)
+    __m128i acc128 = _mm_setzero_si128();
+    for( ; i + 16u <= size; i += 16u )
+      acc128 = _mm_add_epi64( acc128, _mm_sad_epu8(
+        _mm_loadu_si128( reinterpret_cast< const __m128i* >( l + i ) ),
+        _mm_loadu_si128( reinterpret_cast< const __m128i* >( r + i ) )
+      ) );
+    alignas( 16 ) std::array< uint64_t, 2u > lanes128;
+    _mm_store_si128( reinterpret_cast< __m128i* >( lanes128.data() ), acc128 );
+    sum += lanes128[ 0 ] + lanes128[ 1 ];
+#endif
+    for( ; i != size; ++i )
+      sum += ( l[ i ] > r[ i ] ) ? l[ i ] - r[ i ] : r[ i ] - l[ i ];
+    return sum;
+  }
+
+  inline uint64_t sum_levels( const uint8_t *l, size_t size ) {
+    uint64_t sum = 0u;
+    for( size_t i = 0u; i != size; ++i )
+      sum += l[ i ];
+    return sum;
+  }
+}
+
+#endif
+
@@ -5,6 +5,8 @@
 
 #include "common.hpp"
 #include "channel_state.hpp"
+#include "voice_table.hpp"
+#include "note_mapper.hpp"
 
 namespace tinyfm3 {
   constexpr const std::array< std::pair< scale_t, std::array< float, 70u > >, 4u > c = {{ // piano
@@ -21,21 +23,43 @@ namespace tinyfm3 {
     0.9998872,0.1328185,0.1091074,0.0031796,0.0,0.0,1.0,0.0,0.0,0.1800623,0.001678,0.0602197,0.0039134,0.4558271,0.7500252,3.0845764e-04,0.0306528,0.0054125,0.0172467,0.6133548,0.0,0.0,1.0027121,0.0,0.0,0.7744199,0.2499444,0.1170707,1.5017331,3.9994185,0.4383087,0.0027611,0.4763643,0.0702953,0.1200011,6.0301752e-06,0.0,0.0,1.0069851,0.0,0.0,0.1226282,0.3283757,0.0019901,0.8027105,0.438731,0.8325416,0.0094569,0.1224948,0.4943282,0.1000211,0.6183775,0.0,0.0,0.0647725,0.0,0.0,0.9993695,0.9999353,0.999666,3.9999958,3.9875672,0.0547375,0.0013088,0.1252818,0.0268754,0.2647462,0.2497633,0.0,3.0
     }}),
   }};
+  inline const voice_table &get_default_program() {
+    static const voice_table default_program( c.begin(), c.end() );
+    return default_program;
+  }
   class midi_player {
   public:
     midi_player() :
-      channels{{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }} {
-        for( auto &program: programs ) {
-          program[ 0 ].first = c[ 0 ].first;
-          program[ 1 ].first = c[ 1 ].first;
-          program[ 2 ].first = c[ 2 ].first;
-          program[ 3 ].first = c[ 3 ].first;
-          program[ 0 ].second.reset( c[ 0 ].second.begin(), c[ 0 ].second.end() );
-          program[ 1 ].second.reset( c[ 1 ].second.begin(), c[ 1 ].second.end() );
-          program[ 2 ].second.reset( c[ 2 ].second.begin(), c[ 2 ].second.end() );
-          program[ 3 ].second.reset( c[ 3 ].second.begin(), c[ 3 ].second.end() );
-        }
+      state( &midi_player::waiting_for_event ),
+      channel( 0u ),
+      skip_length( 0u ),
+      channels{{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }},
+      channel_mask( 0xFFFFu ) {
+        std::fill( programs.begin(), programs.end(), &get_default_program() );
       }
+    midi_player( const midi_player &src ) :
+      state( src.state ),
+      channel( src.channel ),
+      skip_length( src.skip_length ),
+      channels( src.channels ),
+      programs( src.programs ),
+      channel_mask( src.channel_mask ),
+      mapper( src.mapper ),
+      message_buffer( src.message_buffer ) {
+        mapper.rebind( channels.data() );
+      }
+    midi_player &operator=( const midi_player &src ) {
+      state = src.state;
+      channel = src.channel;
+      skip_length = src.skip_length;
+      channels = src.channels;
+      programs = src.programs;
+      channel_mask = src.channel_mask;
+      mapper = src.mapper;
+      message_buffer = src.message_buffer;
+      mapper.rebind( channels.data() );
+      return *this;
+    }
     bool event( uint8_t v ) {
       if( v < 0x80 ) return (this->*state)( v );
       else return new_event( v );
@@ -45,6 +69,22 @@ namespace tinyfm3 {
       for( Iterator cur = begin; cur != end; ++cur,++mapper )
         *cur = int16_t( mapper() * 32767.f );
     }
+    template< typename Iterator, typename LevelIterator >
+    void operator()( Iterator begin, Iterator end, LevelIterator level ) {
+      for( Iterator cur = begin; cur != end; ++cur, ++level, ++mapper )
+        *cur = mapper.mix( *level );
+    }
+    template< typename Iterator >
+    void render( Iterator begin, Iterator end ) {
+      for( Iterator cur = begin; cur != end; ++cur, ++mapper )
+        *cur = mapper();
+    }
+    void skip( uint32_t count ) {
+      mapper.skip( count );
+    }
+    void set_channel_mask( uint16_t mask ) {
+      channel_mask = mask;
+    }
   private:
     bool waiting_for_event( uint8_t ) { return true; }
     bool note_off_key_number( uint8_t v ) { 
@@ -62,22 +102,11 @@ namespace tinyfm3 {
       state = &midi_player::note_on_velocity;
       return false;
     }
-    fm_config *bisect( channel_t channel, scale_t scale ) {
-      auto &program = programs[ channel ];
-      if( program[ 2 ].first > scale ) {
-        if( program[ 1 ].first > scale ) return &program[ 0 ].second;
-        else return &program[ 1 ].second;
-      }
-      else {
-        if( program[ 3 ].first > scale ) return &program[ 2 ].second;
-        else return &program[ 3 ].second;
-      }
-    }
     bool note_on_velocity( uint8_t v ) {
-      if( channel != 10 ) {
+      if( channel != 10 && ( ( channel_mask >> channel ) & 1u ) ) {
         const scale_t scale = scale_t( message_buffer[ 0 ] - 12 );
-        const auto prog = bisect( channel, scale );
-        mapper.note_on( scale, velocity_t( v ), prog, &channels[ channel ] );
+        const auto voice = &( *programs[ channel ] )[ scale ];
+        mapper.note_on( scale, velocity_t( v ), voice, &channels[ channel ] );
       }
       state = &midi_player::note_on_key_number;
       return true;
@@ -110,14 +139,7 @@ namespace tinyfm3 {
       return false;
     }
     bool program_change( uint8_t v ) {
-      programs[ channel ][ 0 ].first = c[ 0 ].first;
-      programs[ channel ][ 1 ].first = c[ 1 ].first;
-      programs[ channel ][ 2 ].first = c[ 2 ].first;
-      programs[ channel ][ 3 ].first = c[ 3 ].first;
-      programs[ channel ][ 0 ].second.reset( c[ 0 ].second.begin(), c[ 0 ].second.end() );
-      programs[ channel ][ 1 ].second.reset( c[ 1 ].second.begin(), c[ 1 ].second.end() );
-      programs[ channel ][ 2 ].second.reset( c[ 2 ].second.begin(), c[ 2 ].second.end() );
-      programs[ channel ][ 3 ].second.reset( c[ 3 ].second.begin(), c[ 3 ].second.end() );
+      programs[ channel ] = &get_default_program();
       state = &midi_player::program_change;
       return true;
     }
@@ -167,16 +189,7 @@ namespace tinyfm3 {
     bool reset( uint8_t ) { // cc 121
       mapper.reset();
       std::for_each( channels.begin(), channels.end(), []( channel_state &channel ) { channel.reset(); } );
-      for( auto &program: programs ) {
-        program[ 0 ].first = c[ 0 ].first;
-        program[ 1 ].first = c[ 1 ].first;
-        program[ 2 ].first = c[ 2 ].first;
-        program[ 3 ].first = c[ 3 ].first;
-        program[ 0 ].second.reset( c[ 0 ].second.begin(), c[ 0 ].second.end() );
-        program[ 1 ].second.reset( c[ 1 ].second.begin(), c[ 1 ].second.end() );
-        program[ 2 ].second.reset( c[ 2 ].second.begin(), c[ 2 ].second.end() );
-        program[ 3 ].second.reset( c[ 3 ].second.begin(), c[ 3 ].second.end() );
-      }
+      std::fill( programs.begin(), programs.end(), &get_default_program() );
       state = &midi_player::control_change_key;
       return true;
     }
@@ -209,7 +222,8 @@ namespace tinyfm3 {
     channel_t channel;
     unsigned int skip_length;
     std::array< channel_state, 16u > channels;
-    std::array< std::array< std::pair< uint8_t, fm_config >, 4u >, 16u > programs;
+    std::array< const voice_table*, 16u > programs;
+    uint16_t channel_mask;
     tinyfm3::note_mapper mapper;
     std::array< uint8_t, 16u > message_buffer;
   };
@@ -1,38 +1,63 @@
 #ifndef TINYFM3_MIDI_SEQUENCER_HPP
 #define TINYFM3_MIDI_SEQUENCER_HPP
 
+#include <cstdint>
 #include <array>
+#include <limits>
+#include <algorithm>
 
 #include "common.hpp"
 #include "midi_player.hpp"
 
 namespace tinyfm3 {
   struct sequencer_state {
-    sequencer_state() : track_count( 0u ), resolution( 480 ), ms_to_delta_time( 0.96 ) {}
+    sequencer_state() : track_count( 0u ), resolution( 480u ), tempo( 500000u ), anchor_tick( 0u ), anchor_sample( 0u ) {}
+    void reset( uint32_t resolution_ ) {
+      resolution = resolution_;
+      tempo = 500000u;
+      anchor_tick = 0u;
+      anchor_sample = 0u;
+    }
+    uint64_t tick_to_sample( uint64_t tick ) const {
+      const uint64_t elapsed = tick - anchor_tick;
+      const uint64_t quarter = elapsed / resolution * tempo;
+      const uint64_t numerator =
+        ( quarter % 1000000u ) * frequency * resolution +
+        elapsed % resolution * tempo * frequency;
+      const uint64_t denominator = uint64_t( resolution ) * 1000000u;
+      return anchor_sample + quarter / 1000000u * frequency + ( numerator + denominator - 1u ) / denominator;
+    }
+    void set_tempo( uint32_t tempo_, uint64_t tick ) {
+      anchor_sample = tick_to_sample( tick );
+      anchor_tick = tick;
+      tempo = tempo_;
+    }
     unsigned int track_count;
-    float resolution;
-    float ms_to_delta_time;
+    uint32_t resolution;
+    uint32_t tempo;
+    uint64_t anchor_tick;
+    uint64_t anchor_sample;
   };
 
   template< typename Iterator >
   class track_sequencer {
   public:
-    track_sequencer() : player( nullptr ), state( nullptr ), next_event_time( std::numeric_limits< uint32_t >::max() ), cur( nullptr ), end( nullptr ) {
+    track_sequencer() : player( nullptr ), state( nullptr ), next_event_time( std::numeric_limits< uint32_t >::max() ), running_status( 0u ), cur( nullptr ), end( nullptr ) {
     }
     void load( midi_player *player_, sequencer_state *state_, Iterator begin, Iterator end_ ) {
       player = player_;
       state = state_;
       cur = begin;
       end = end_;
+      running_status = 0u;
       next_event_time = 0u;
       next_event_time = delta_time();
     }
     bool is_end() const { return cur == end; }
-    void operator()( uint32_t now ) {
-      while( next_event_time <= now ) {
-        event();
-        next_event_time = delta_time();
-      }
+    uint32_t get_next_event_time() const { return next_event_time; }
+    void operator()() {
+      event();
+      next_event_time = delta_time();
     }
   private:
     uint32_t delta_time() {
@@ -95,7 +120,7 @@ namespace tinyfm3 {
               beat <<= 8u;
               beat |= *cur;
               ++cur;
-              state->ms_to_delta_time = float( state->resolution ) * 1000.f / float( beat );
+              if( beat ) state->set_tempo( beat, next_event_time );
             }
             else {
               if( std::distance( cur, end ) >= length )
@@ -123,12 +148,19 @@ namespace tinyfm3 {
         sysex( head );
       else if( head == 0xFF )
         meta_event( head );
-      else
+      else if( head & 0x80 ) {
+        if( head < 0xF0 ) running_status = head;
+        midi_event( head );
+      }
+      else if( running_status ) {
+        player->event( running_status );
         midi_event( head );
+      }
     }
     midi_player *player;
     sequencer_state *state;
     uint32_t next_event_time;
+    uint8_t running_status;
     Iterator cur;
     Iterator end;
   };
@@ -162,12 +194,12 @@ namespace tinyfm3 {
       resolution <<= 8;
       resolution |= *cur;
       ++cur;
-      state.resolution = resolution;
-      state.ms_to_delta_time = state.resolution * 1000.f / 500000.f;
+      if( !resolution ) return false;
+      state.reset( resolution );
       constexpr static const std::array< uint8_t, 4u > track_magic {{
         'M', 'T', 'r', 'k'
       }};
-      now = 0.f;
+      now = 0u;
       for( unsigned int i = 0u; i != track_count; ++i ) {
         if( std::distance( cur, end ) < 4 ) return false;
         if( !std::equal( track_magic.begin(), track_magic.end(), cur ) ) return false;
@@ -193,19 +225,51 @@ namespace tinyfm3 {
     }
     template< typename OutputIterator >
     void operator()( OutputIterator begin, OutputIterator end ) {
-      for( unsigned int i = 0u; i != state.track_count; ++i )
-        tracks[ i ]( now );
-      player( begin, end );
-      now += std::distance( begin, end ) * delta * 1000.f * state.ms_to_delta_time;
+      while( begin != end ) {
+        const auto length = next_block( std::distance( begin, end ) );
+        const auto block_end = std::next( begin, length );
+        player( begin, block_end );
+        begin = block_end;
+      }
+    }
+    template< typename OutputIterator, typename LevelIterator >
+    void operator()( OutputIterator begin, OutputIterator end, LevelIterator level ) {
+      while( begin != end ) {
+        const auto length = next_block( std::distance( begin, end ) );
+        const auto block_end = std::next( begin, length );
+        player( begin, block_end, level );
+        begin = block_end;
+        level = std::next( level, length );
+      }
     }
+    midi_player &get_player() { return player; }
     bool is_end() {
       return std::find_if( tracks.begin(), std::next( tracks.begin(), state.track_count ), []( const track_sequencer< Iterator > &t ) { return !t.is_end(); } ) == std::next( tracks.begin(), state.track_count );
     }
   private:
+    track_sequencer< Iterator > *next_track() {
+      track_sequencer< Iterator > *next = nullptr;
+      for( unsigned int i = 0u; i != state.track_count; ++i )
+        if( !tracks[ i ].is_end() && ( !next || tracks[ i ].get_next_event_time() < next->get_next_event_time() ) )
+          next = &tracks[ i ];
+      return next;
+    }
+    uint64_t next_block( uint64_t length ) {
+      while( auto track = next_track() ) {
+        const uint64_t event_sample = state.tick_to_sample( track->get_next_event_time() );
+        if( event_sample > now ) {
+          length = std::min( length, event_sample - now );
+          break;
+        }
+        ( *track )();
+      }
+      now += length;
+      return length;
+    }
     midi_player player;
     sequencer_state state;
     std::array< track_sequencer< Iterator >, 16u > tracks;
-    float now;
+    uint64_t now;
   };
 }
 
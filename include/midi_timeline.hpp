@@ -0,0 +1,235 @@
+#ifndef TINYFM3_MIDI_TIMELINE_HPP
+#define TINYFM3_MIDI_TIMELINE_HPP
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <thread>
+#include <iterator>
+#include <algorithm>
+
+#include "common.hpp"
+#include "midi_player.hpp"
+#include "midi_sequencer2.hpp"
+
+namespace tinyfm3 {
+  struct timeline_event {
+    uint64_t sample;
+    uint8_t length;
+    std::array< uint8_t, 3u > data;
+  };
+
+  class midi_timeline {
+  public:
+    struct tempo_change {
+      uint64_t tick;
+      uint64_t sample;
+      uint32_t tempo;
+    };
+    midi_timeline() : length( 0u ) {}
+    template< typename Iterator >
+    bool load( Iterator begin, Iterator end ) {
+      events.clear();
+      tempo_map.clear();
+      length = 0u;
+      if( std::distance( begin, end ) < 14 ) return false;
+      constexpr static const std::array< uint8_t, 8u > header_magic {{
+        'M', 'T', 'h', 'd', 0, 0, 0, 6
+      }};
+      if( !std::equal( header_magic.begin(), header_magic.end(), begin ) ) return false;
+      auto cur = std::next( begin, header_magic.size() );
+      const uint16_t format = read_be( cur, 2u );
+      if( format >= 2 ) return false;
+      uint16_t track_count = read_be( cur, 2u );
+      if( track_count > 16u ) track_count = 16u;
+      const uint16_t resolution = read_be( cur, 2u );
+      if( !resolution ) return false;
+      constexpr static const std::array< uint8_t, 4u > track_magic {{
+        'M', 'T', 'r', 'k'
+      }};
+      std::vector< raw_event > raw;
+      uint64_t end_tick = 0u;
+      for( unsigned int i = 0u; i != track_count; ++i ) {
+        if( std::distance( cur, end ) < 8 ) return false;
+        if( !std::equal( track_magic.begin(), track_magic.end(), cur ) ) return false;
+        cur = std::next( cur, track_magic.size() );
+        const uint32_t track_length = read_be( cur, 4u );
+        if( std::distance( cur, end ) < track_length ) return false;
+        const auto track_end = std::next( cur, track_length );
+        end_tick = std::max( end_tick, compile_track( raw, cur, track_end ) );
+        cur = track_end;
+      }
+      std::stable_sort( raw.begin(), raw.end(), []( const raw_event &l, const raw_event &r ) { return l.tick < r.tick; } );
+      sequencer_state state;
+      state.reset( resolution );
+      for( const auto &e: raw ) {
+        if( e.tempo ) {
+          state.set_tempo( e.tempo, e.tick );
+          tempo_map.push_back( tempo_change{ e.tick, state.tick_to_sample( e.tick ), e.tempo } );
+        }
+        else
+          events.push_back( timeline_event{ state.tick_to_sample( e.tick ), e.length, e.data } );
+      }
+      length = state.tick_to_sample( end_tick );
+      return true;
+    }
+    const std::vector< timeline_event > &get_events() const { return events; }
+    const std::vector< tempo_change > &get_tempo_map() const { return tempo_map; }
+    uint64_t get_length() const { return length; }
+    size_t find( uint64_t sample ) const {
+      return std::distance( events.begin(), std::lower_bound( events.begin(), events.end(), sample, []( const timeline_event &e, uint64_t s ) { return e.sample < s; } ) );
+    }
+  private:
+    struct raw_event {
+      uint64_t tick;
+      uint32_t tempo;
+      uint8_t length;
+      std::array< uint8_t, 3u > data;
+    };
+    template< typename Iterator >
+    static uint32_t read_be( Iterator &cur, unsigned int size ) {
+      uint32_t value = 0u;
+      for( unsigned int i = 0u; i != size; ++i, ++cur )
+        value = ( value << 8 ) | *cur;
+      return value;
+    }
+    template< typename Iterator >
+    static uint32_t read_vlq( Iterator &cur, Iterator end ) {
+      uint32_t value = 0u;
+      for( ; cur != end; ++cur ) {
+        value = ( value << 7 ) | ( *cur & 0x7F );
+        if( !( *cur & 0x80 ) ) {
+          ++cur;
+          break;
+        }
+      }
+      return value;
+    }
+    template< typename Iterator >
+    static void skip( Iterator &cur, Iterator end, uint32_t size ) {
+      if( std::distance( cur, end ) >= size ) cur = std::next( cur, size );
+      else cur = end;
+    }
+    template< typename Iterator >
+    static uint64_t compile_track( std::vector< raw_event > &raw, Iterator cur, Iterator end ) {
+      uint64_t tick = 0u;
+      uint8_t running_status = 0u;
+      while( cur != end ) {
+        tick += read_vlq( cur, end );
+        if( cur == end ) break;
+        uint8_t head = *cur;
+        if( head == 0xF0 || head == 0xF7 ) {
+          ++cur;
+          skip( cur, end, read_vlq( cur, end ) );
+        }
+        else if( head == 0xFF ) {
+          ++cur;
+          if( cur == end ) break;
+          const auto event_type = *cur;
+          ++cur;
+          const auto size = read_vlq( cur, end );
+          if( event_type == 0x2F ) break;
+          if( event_type == 0x51 && size == 3u && std::distance( cur, end ) >= 3 ) {
+            const uint32_t tempo = read_be( cur, 3u );
+            if( tempo ) raw.push_back( raw_event{ tick, tempo, 0u, {{ 0u, 0u, 0u }} } );
+          }
+          else skip( cur, end, size );
+        }
+        else if( head >= 0xF0 ) ++cur;
+        else {
+          if( head & 0x80 ) {
+            running_status = head;
+            ++cur;
+          }
+          else if( !running_status ) {
+            ++cur;
+            continue;
+          }
+          raw_event e{ tick, 0u, 1u, {{ running_status, 0u, 0u }} };
+          const uint8_t data_length = ( ( running_status & 0xE0 ) == 0xC0 ) ? 1u : 2u;
+          for( uint8_t i = 0u; i != data_length && cur != end && !( *cur & 0x80 ); ++i, ++cur )
+            e.data[ e.length++ ] = *cur;
+          if( e.length == data_length + 1u ) raw.push_back( e );
+        }
+      }
+      return tick;
+    }
+    std::vector< timeline_event > events;
+    std::vector< tempo_change > tempo_map;
+    uint64_t length;
+  };
+
+  class timeline_player {
+  public:
+    timeline_player( const midi_timeline &timeline_ ) : timeline( &timeline_ ), next( 0u ), now( 0u ) {}
+    void reset() {
+      player = midi_player();
+      next = 0u;
+      now = 0u;
+    }
+    void seek( uint64_t sample ) {
+      if( sample < now ) reset();
+      const auto &events = timeline->get_events();
+      for( ; next != events.size() && events[ next ].sample < sample; ++next ) {
+        player.skip( uint32_t( events[ next ].sample - now ) );
+        now = events[ next ].sample;
+        dispatch( events[ next ] );
+      }
+      player.skip( uint32_t( sample - now ) );
+      now = sample;
+    }
+    template< typename OutputIterator >
+    void operator()( OutputIterator begin, OutputIterator end ) {
+      const auto &events = timeline->get_events();
+      while( begin != end ) {
+        for( ; next != events.size() && events[ next ].sample <= now; ++next )
+          dispatch( events[ next ] );
+        uint64_t length = std::distance( begin, end );
+        if( next != events.size() )
+          length = std::min( length, events[ next ].sample - now );
+        const auto block_end = std::next( begin, length );
+        player.render( begin, block_end );
+        begin = block_end;
+        now += length;
+      }
+    }
+    uint64_t get_position() const { return now; }
+  private:
+    void dispatch( const timeline_event &e ) {
+      for( uint8_t i = 0u; i != e.length; ++i )
+        player.event( e.data[ i ] );
+    }
+    const midi_timeline *timeline;
+    midi_player player;
+    size_t next;
+    uint64_t now;
+  };
+
+  template< typename OutputIterator >
+  void render_timeline( const midi_timeline &timeline, OutputIterator output, uint64_t length, unsigned int slice_count, uint64_t warmup ) {
+    slice_count = std::max( slice_count, 1u );
+    const uint64_t slice_length = ( length + slice_count - 1u ) / slice_count;
+    std::vector< timeline_player > players;
+    timeline_player cursor( timeline );
+    for( unsigned int i = 0u; i != slice_count; ++i ) {
+      const uint64_t begin = std::min( i * slice_length, length );
+      cursor.seek( begin - std::min( begin, warmup ) );
+      players.push_back( cursor );
+    }
+    std::vector< std::thread > threads;
+    for( unsigned int i = 0u; i != slice_count; ++i ) {
+      threads.emplace_back( [&,i]() {
+        const uint64_t begin = std::min( i * slice_length, length );
+        const uint64_t end = std::min( begin + slice_length, length );
+        auto &player = players[ i ];
+        std::vector< float > discard( begin - player.get_position() );
+        player( discard.begin(), discard.end() );
+        player( std::next( output, begin ), std::next( output, end ) );
+      } );
+    }
+    for( auto &thread: threads ) thread.join();
+  }
+}
+
+#endif
+
@@ -1,3 +1,10 @@
+#ifndef TINYFM3_NORMALIZER_HPP
+#define TINYFM3_NORMALIZER_HPP
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+
 #include "common.hpp"
 
 namespace tinyfm3 {
@@ -39,15 +46,23 @@ namespace tinyfm3 {
   public:
     normalizer() : scale( 1.f ) {}
     float operator()( float sample, float active_channels ) {
-      const float limit = scale_table[ ceilf( active_channels ) ]*( 1.f/65536.f );
+      const float limit = scale_table[ std::min( size_t( ceilf( active_channels ) ), scale_table.size() - 1u ) ]*( 1.f/65536.f );
       if( scale < limit )
         scale += ( 1.f/65536.f );
       if( scale > limit )
         scale = limit;
       return sample * scale;
     }
+    void skip( uint32_t count, float active_channels ) {
+      const float limit = scale_table[ std::min( size_t( ceilf( active_channels ) ), scale_table.size() - 1u ) ]*( 1.f/65536.f );
+      if( scale < limit )
+        scale = std::min( scale + count * ( 1.f/65536.f ), limit );
+      else
+        scale = limit;
+    }
   private:
     float scale;
   };
 }
 
+#endif
@@ -1,191 +1,174 @@
+#ifndef TINYFM3_NOTE_MAPPER_HPP
+#define TINYFM3_NOTE_MAPPER_HPP
+
 #include <cstdint>
+#include <array>
+#include <algorithm>
 #include "common.hpp"
 #include "fm_operator.hpp"
 #include "normalizer.hpp"
 
 namespace tinyfm3 {
-  template< unsigned int i, unsigned int j = 0u >
-  struct least_pot : public least_pot< ( i >> 1 ), j + 1u > {};
-  template< unsigned int j >
-  struct least_pot< 1u, j > {
-    constexpr static unsigned int value = j;
-  };
-  template< unsigned int i, unsigned int j = 1u >
-  struct least_mask : public least_mask< ( i >> 1 ), j << 1 > {};
-  template< unsigned int j >
-  struct least_mask< 1u, j > {
-    constexpr static unsigned int value = j - 1;
-  };
-  template< unsigned int size_ >
-  class slot_queue {
-    constexpr static unsigned int shift = least_pot< polyphony_count >::value;
-    constexpr static unsigned int capacity_ = ( 1u << least_pot< size_ >::value );
-    constexpr static unsigned int mask = least_mask< size_ >::value;
-    using data_type = std::array< slot_id_t, capacity_ >;
-  public:
-    slot_queue() : head( 0u ), tail( 0u ) {}
-    bool push( slot_id_t elem ) {
-      if( full() ) gc();
-      if( full() ) return false;
-      data[ head++ ] = elem;
-      if( head == capacity_ ) head = 0u;
-      return true;
-    }
-    slot_id_t pop() {
-      if( empty() ) {
-        return std::numeric_limits<slot_id_t>::max();
-      }
-      slot_id_t value = data[ tail++ ];
-      if( tail == capacity_ ) tail = 0u;
-      return value;
-    }
-    bool erase( slot_id_t elem ) {
-      if( tail < head ) {
-        const auto search_result = std::find( std::next( data.begin(), tail ), std::next( data.end(), head ), elem );
-        if( search_result != data.end() ) {
-          *search_result = std::numeric_limits<slot_id_t>::max();
-          return true;
-        }
-      }
-      else if( head < tail ) {
-        const auto search_result = std::find( data.begin(), std::next( data.begin(), head ), elem );
-        if( search_result != std::next( data.begin(), head ) ) {
-          *search_result = std::numeric_limits<slot_id_t>::max();
-          return true;
-        }
-        else {
-          const auto search_result = std::find( std::next( data.begin(), tail ), data.end(), elem );
-          if( search_result != data.end() ) {
-            *search_result = std::numeric_limits<slot_id_t>::max();
-            return true;
-          }
-        }
-      }
-      return false;
-    }
-    slot_id_t erase( channel_t channel, scale_t scale ) {
-      const slot_id_t id( ( channel << ( shift + 7u ) )|( scale << shift ) );
-      const slot_id_t mask_( ~mask );
-      if( tail < head ) {
-        const auto search_result = std::find_if( std::next( data.begin(), tail ), std::next( data.begin(), head ), [&]( slot_id_t v ) { return v & mask_ == id; } );
-        if( search_result != data.end() ) {
-          const slot_id_t old = *search_result;
-          *search_result = std::numeric_limits<slot_id_t>::max();
-          return old;
-        }
-      }
-      else if( head < tail ) {
-        const auto search_result = std::find_if( data.begin(), std::next( data.begin(), head ), [&]( slot_id_t v ) { return v & mask_ == id; } );
-        if( search_result != std::next( data.begin(), head ) ) {
-          const slot_id_t old = *search_result;
-          *search_result = std::numeric_limits<slot_id_t>::max();
-          return old;
-        }
-        else {
-          const auto search_result = std::find_if( std::next( data.begin(), tail ), data.end(), [&]( slot_id_t v ) { return v & mask_ == id; } );
-          if( search_result != data.end() ) {
-            const slot_id_t old = *search_result;
-            *search_result = std::numeric_limits<slot_id_t>::max();
-            return old;
-          }
-        }
-      }
-      return std::numeric_limits<slot_id_t>::max();
-    }
-    bool empty() {
-      if( head == tail ) return true;
-      else if( data[ tail ] != std::numeric_limits<slot_id_t>::max() ) return false;
-      ++tail;
-      return empty();
-    }
-    bool full() const {
-      return (( head + 1 ) & mask ) == tail;
-    }
-    template< typename F >
-    void channel_event( channel_t channel, F f ) {
-      for( unsigned int cur = tail; cur != head; ++cur ) {
-        if( cur == size_ ) cur = 0u;
-        if( data[ cur ] >> ( shift + 7u ) == channel )
-          f( data[ cur ] );
-      }
-    }
-  private:
-    void gc() {
-      unsigned int dest = tail;
-      for( unsigned int src = tail; ( src & mask ) != head; ++src ) {
-        if( data[ src & mask ] != std::numeric_limits<slot_id_t>::max() )
-          data[ dest++ & mask ] = data[ src & mask ];
-      }
-      head = dest & mask;
-    }
-    data_type data;
-    unsigned int head;
-    unsigned int tail;
-  };
   class note_mapper {
-    constexpr static unsigned int shift = least_pot< polyphony_count >::value;
-    constexpr static unsigned int mask = least_mask< polyphony_count >::value;
+    using voice_id_t = uint16_t;
+    constexpr static voice_id_t none = 0xFFFFu;
+    constexpr static unsigned int note_count = 16u * 256u;
+    constexpr static uint32_t skip_step = 256u;
   public:
     note_mapper() {
-      for( unsigned int i = 0u; i != polyphony_count; ++i )
-        released_slots.push( i );
+      clear();
     }
     slot_id_t note_on( uint8_t scale, uint8_t velocity, const fm_config *config_, const channel_state *cs ) {
-      const auto old_slot = get_slot();
-      const auto new_slot = ( old_slot & mask ) | ( scale << shift ) | ( cs->index << ( shift + 7u ) );
-      slots[ new_slot & mask ].note_on( scale, velocity/127.f, config_, cs );
-      active_slots.push( new_slot );
-      return new_slot;
+      const auto voice = allocate( cs->index, scale );
+      slots[ voice ].note_on( scale, velocity/127.f, config_, cs );
+      return voice;
+    }
+    slot_id_t note_on( uint8_t scale, uint8_t velocity, const key_voice *voice_, const channel_state *cs ) {
+      const auto voice = allocate( cs->index, scale );
+      slots[ voice ].note_on( scale, velocity/127.f, voice_, cs );
+      return voice;
     }
     void note_off( channel_t channel, scale_t scale ) {
-      const auto slot = active_slots.erase( channel, scale );
-      if( slot != std::numeric_limits<slot_id_t>::max() ) {
-        slots[ slot & mask ].note_off();
-        released_slots.push( slot );
+      const auto voice = note_to_voice[ get_note( channel, scale ) ];
+      if( voice != none ) {
+        slots[ voice ].note_off();
+        unmap( voice );
       }
     }
     void pitch_bend( channel_t channel ) {
-      active_slots.channel_event( channel, [&]( slot_id_t slot ) { slots[ slot & mask ].pitch_bend(); } );
+      for( unsigned int i = 0u; i != live_count; ++i ) {
+        const auto note = voice_to_note[ live[ i ] ];
+        if( note != none && ( note >> 8 ) == channel )
+          slots[ live[ i ] ].pitch_bend();
+      }
     }
     void operator++() {
+      for( unsigned int i = 0u; i != live_count; ) {
+        const auto voice = live[ i ];
+        ++slots[ voice ];
+        if( slots[ voice ] ) ++i;
+        else release( i );
+      }
+    }
+    void skip( uint32_t count ) {
+      while( count ) {
+        const uint32_t run = std::min( count, uint32_t( skip_step ) );
+        float active_channels = 0;
+        for( unsigned int i = 0u; i != live_count; ++i )
+          active_channels += slots[ live[ i ] ].get_level();
+        norm.skip( run, active_channels );
+        for( unsigned int i = 0u; i != live_count; ) {
+          const auto voice = live[ i ];
+          slots[ voice ] += run;
+          if( slots[ voice ] ) ++i;
+          else release( i );
+        }
+        count -= run;
+      }
+    }
+    void rebind( const channel_state *channels ) {
       for( auto &slot: slots )
-        ++slot;
+        slot.rebind( channels );
     }
     float operator()() {
+      float active_channels;
+      const float output = mix( active_channels );
+      return norm( output, active_channels );
+    }
+    float mix( float &active_channels ) {
       float output = 0;
-      float active_channels = 0;
-      for( auto &slot: slots ) {
+      active_channels = 0;
+      for( unsigned int i = 0u; i != live_count; ++i ) {
+        auto &slot = slots[ live[ i ] ];
         output += slot();
         active_channels += slot.get_level();
       }
-      return norm( output, active_channels );
+      return output;
     }
     void reset() {
-      slot_id_t slot;
-      while( ( slot = active_slots.pop() ) != std::numeric_limits<slot_id_t>::max() ) {
-        released_slots.push( slot );
-      }
       for( auto &slot: slots )
         slot.reset();
+      clear();
     }
     void all_note_off() {
-      slot_id_t slot;
-      while( ( slot = active_slots.pop() ) != std::numeric_limits<slot_id_t>::max() ) {
-        slots[ slot & mask ].note_off();
-        released_slots.push( slot );
+      for( unsigned int i = 0u; i != live_count; ++i ) {
+        if( voice_to_note[ live[ i ] ] != none ) {
+          slots[ live[ i ] ].note_off();
+          unmap( live[ i ] );
+        }
       }
     }
   private:
-    slot_id_t get_slot() {
-      const auto slot = released_slots.pop();
-      if( slot != std::numeric_limits<slot_id_t>::max() )
-        return slot;
-      return active_slots.pop();
+    static unsigned int get_note( channel_t channel, scale_t scale ) {
+      return ( unsigned int )( ( channel & 0x0F ) << 8 ) | scale;
+    }
+    void clear() {
+      std::fill( note_to_voice.begin(), note_to_voice.end(), voice_id_t( none ) );
+      std::fill( voice_to_note.begin(), voice_to_note.end(), voice_id_t( none ) );
+      std::fill( is_live.begin(), is_live.end(), false );
+      live_count = 0u;
+      free_count = 0u;
+      for( unsigned int i = polyphony_count; i != 0u; --i )
+        free_voices[ free_count++ ] = voice_id_t( i - 1u );
+    }
+    void release( unsigned int i ) {
+      const auto voice = live[ i ];
+      unmap( voice );
+      is_live[ voice ] = false;
+      live[ i ] = live[ --live_count ];
+      free_voices[ free_count++ ] = voice;
+    }
+    void unmap( voice_id_t voice ) {
+      const auto note = voice_to_note[ voice ];
+      if( note != none ) {
+        note_to_voice[ note ] = none;
+        voice_to_note[ voice ] = none;
+      }
+    }
+    voice_id_t allocate( channel_t channel, scale_t scale ) {
+      const auto note = get_note( channel, scale );
+      const auto held = note_to_voice[ note ];
+      if( held != none ) {
+        slots[ held ].note_off();
+        unmap( held );
+      }
+      const voice_id_t voice = free_count ? free_voices[ --free_count ] : steal();
+      unmap( voice );
+      note_to_voice[ note ] = voice;
+      voice_to_note[ voice ] = voice_id_t( note );
+      if( !is_live[ voice ] ) {
+        is_live[ voice ] = true;
+        live[ live_count++ ] = voice;
+      }
+      return voice;
+    }
+    voice_id_t steal() const {
+      voice_id_t victim = live[ 0 ];
+      bool victim_held = voice_to_note[ victim ] != none;
+      float victim_level = slots[ victim ].get_amplitude();
+      for( unsigned int i = 1u; i != live_count; ++i ) {
+        const auto voice = live[ i ];
+        const bool held = voice_to_note[ voice ] != none;
+        if( held && !victim_held ) continue;
+        const float level = slots[ voice ].get_amplitude();
+        if( ( !held && victim_held ) || level < victim_level ) {
+          victim = voice;
+          victim_held = held;
+          victim_level = level;
+        }
+      }
+      return victim;
     }
     std::array< fm, polyphony_count > slots;
-    slot_queue< polyphony_count > active_slots;
-    slot_queue< polyphony_count > released_slots;
+    std::array< voice_id_t, note_count > note_to_voice;
+    std::array< voice_id_t, polyphony_count > voice_to_note;
+    std::array< voice_id_t, polyphony_count > live;
+    std::array< voice_id_t, polyphony_count > free_voices;
+    std::array< bool, polyphony_count > is_live;
+    unsigned int live_count;
+    unsigned int free_count;
     normalizer norm;
   };
 }
 
+#endif
@@ -0,0 +1,170 @@
+#ifndef TINYFM3_NUMA_TOPOLOGY_HPP
+#define TINYFM3_NUMA_TOPOLOGY_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace tinyfm3 {
+  inline std::vector< unsigned int > parse_cpu_list( const std::string &list ) {
+    std::vector< unsigned int > cpus;
+    size_t pos = 0u;
+    while( pos < list.size() ) {
+      size_t next = list.find( ',', pos );
+      if( next == std::string::npos ) next = list.size();
+      const std::string range = list.substr( pos, next - pos );
+      const size_t dash = range.find( '-' );
+      try {
+        const unsigned int first = std::stoul( range.substr( 0u, dash ) );
+        const unsigned int last = dash == std::string::npos ? first : std::stoul( range.substr( dash + 1u ) );
+        for( unsigned int cpu = first; cpu <= last; ++cpu )
+          cpus.push_back( cpu );
+      } catch( const std::exception& ) {}
+      pos = next + 1u;
+    }
+    return cpus;
+  }
+
+  class numa_topology {
+  public:
+    numa_topology() {
+      std::string online;
+      std::ifstream online_file( "/sys/devices/system/node/online" );
+      if( online_file && std::getline( online_file, online ) ) {
+        for( const auto node: parse_cpu_list( online ) ) {
+          std::string cpu_list;
+          std::ifstream cpu_file( "/sys/devices/system/node/node" + std::to_string( node ) + "/cpulist" );
+          if( !cpu_file || !std::getline( cpu_file, cpu_list ) ) continue;
+          auto cpus = parse_cpu_list( cpu_list );
+          if( !cpus.empty() ) nodes.emplace_back( std::move( cpus ) );
+        }
+      }
+      if( nodes.empty() ) {
+        nodes.emplace_back();
+        for( unsigned int cpu = 0u; cpu != std::max( std::thread::hardware_concurrency(), 1u ); ++cpu )
+          nodes.back().push_back( cpu );
+      }
+    }
+    size_t get_node_count() const { return nodes.size(); }
+    const std::vector< unsigned int > &get_cpus( size_t node ) const { return nodes[ node ]; }
+    static bool bind( const std::vector< unsigned int > &cpus ) {
+#if defined(__linux__)
+      cpu_set_t set;
+      CPU_ZERO( &set );
+      for( const auto cpu: cpus )
+        if( cpu < CPU_SETSIZE ) CPU_SET( cpu, &set );
+      return !pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+#else
+      return false;
+#endif
+    }
+  private:
+    std::vector< std::vector< unsigned int > > nodes;
+  };
+
+  class pinned_workers {
+  public:
+    pinned_workers( unsigned int count_, bool pin_ ) : count( std::max( count_, 1u ) ), pin( pin_ ), generation( 0u ), finished( 0u ), closing( false ) {
+      if( pin ) {
+        for( unsigned int t = 0u; t != count; ++t ) {
+          const size_t node = t % topology.get_node_count();
+          const auto &cpus = topology.get_cpus( node );
+          nodes.push_back( node );
+          assigned_cpus.push_back( cpus[ ( t / topology.get_node_count() ) % cpus.size() ] );
+        }
+      }
+      else {
+        nodes.assign( count, 0u );
+        assigned_cpus.assign( count, 0u );
+      }
+      if( count != 1u || pin )
+        for( unsigned int t = 0u; t != count; ++t )
+          threads.emplace_back( [this,t]() { run( t ); } );
+    }
+    pinned_workers( const pinned_workers& ) = delete;
+    pinned_workers &operator=( const pinned_workers& ) = delete;
+    ~pinned_workers() {
+      {
+        std::lock_guard< std::mutex > lock( guard );
+        closing = true;
+      }
+      start.notify_all();
+      for( auto &thread: threads ) thread.join();
+    }
+    unsigned int get_count() const { return count; }
+    size_t get_node_count() const { return pin ? std::min( topology.get_node_count(), size_t( count ) ) : 1u; }
+    const numa_topology &get_topology() const { return topology; }
+    template< typename F >
+    void operator()( F f ) const {
+      if( threads.empty() ) {
+        f( 0u, size_t( 0u ) );
+        return;
+      }
+      std::unique_lock< std::mutex > lock( guard );
+      task = f;
+      finished = 0u;
+      ++generation;
+      start.notify_all();
+      done.wait( lock, [this]() { return finished == count; } );
+      task = nullptr;
+    }
+    template< typename F >
+    void on_node( size_t node, F f ) const {
+      if( !pin ) {
+        f();
+        return;
+      }
+      std::thread thread( [&]() {
+        numa_topology::bind( topology.get_cpus( node ) );
+        f();
+      } );
+      thread.join();
+    }
+  private:
+    void run( unsigned int t ) {
+      if( pin ) numa_topology::bind( std::vector< unsigned int >{ assigned_cpus[ t ] } );
+      size_t seen = 0u;
+      while( true ) {
+        {
+          std::unique_lock< std::mutex > lock( guard );
+          start.wait( lock, [&]() { return closing || generation != seen; } );
+          if( closing ) return;
+          seen = generation;
+        }
+        task( t, nodes[ t ] );
+        {
+          std::lock_guard< std::mutex > lock( guard );
+          ++finished;
+        }
+        done.notify_one();
+      }
+    }
+    numa_topology topology;
+    unsigned int count;
+    bool pin;
+    std::vector< size_t > nodes;
+    std::vector< unsigned int > assigned_cpus;
+    mutable std::mutex guard;
+    mutable std::condition_variable start;
+    mutable std::condition_variable done;
+    mutable std::function< void( unsigned int, size_t ) > task;
+    mutable size_t generation;
+    mutable unsigned int finished;
+    bool closing;
+    std::vector< std::thread > threads;
+  };
+}
+
+#endif
+
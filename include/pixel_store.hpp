@@ -0,0 +1,224 @@
+#ifndef TINYFM3_PIXEL_STORE_HPP
+#define TINYFM3_PIXEL_STORE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <memory>
+#include <algorithm>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace tinyfm3 {
+  enum class pixel_precision {
+    float32,
+    float16,
+    bfloat16
+  };
+
+  inline bool parse_pixel_precision( const std::string &name, pixel_precision &precision ) {
+    if( name == "float32" ) precision = pixel_precision::float32;
+    else if( name == "float16" ) precision = pixel_precision::float16;
+    else if( name == "bfloat16" ) precision = pixel_precision::bfloat16;
+    else return false;
+    return true;
+  }
+
+  inline uint16_t float_to_half( float value ) {
+#if defined(__F16C__)
+    return _cvtss_sh( value, 0 );
+#else
+    uint32_t bits;
+    std::memcpy( &bits, &value, sizeof( bits ) );
+    const uint32_t sign = ( bits >> 16 ) & 0x8000u;
+    const uint32_t magnitude = bits & 0x7FFFFFFFu;
+    if( magnitude >= 0x7F800000u )
+      return sign | 0x7C00u | ( magnitude > 0x7F800000u ? 0x200u : 0u );
+    if( magnitude >= 0x477FF000u ) return sign | 0x7C00u;
+    if( magnitude < 0x38800000u ) {
+      if( magnitude < 0x33000000u ) return sign;
+      const uint32_t shift = 126u - ( magnitude >> 23 );
+      const uint32_t mantissa = ( magnitude & 0x7FFFFFu ) | 0x800000u;
+      const uint32_t half = mantissa >> shift;
+      const uint32_t rest = mantissa & ( ( 1u << shift ) - 1u );
+      const uint32_t halfway = 1u << ( shift - 1u );
+      return sign | ( half + ( rest > halfway || ( rest == halfway && ( half & 1u ) ) ) );
+    }
+    const uint32_t rounded = magnitude - 0x38000000u + 0xFFFu + ( ( magnitude >> 13 ) & 1u );
+    return sign | ( rounded >> 13 );
+#endif
+  }
+
+  inline float half_to_float( uint16_t value ) {
+#if defined(__F16C__)
+    return _cvtsh_ss( value );
+#else
+    const uint32_t sign = uint32_t( value & 0x8000u ) << 16;
+    uint32_t exponent = ( value >> 10 ) & 0x1Fu;
+    uint32_t mantissa = value & 0x3FFu;
+    uint32_t bits;
+    if( exponent == 0x1Fu ) bits = sign | 0x7F800000u | ( mantissa << 13 );
+    else if( exponent ) bits = sign | ( ( exponent + 112u ) << 23 ) | ( mantissa << 13 );
+    else if( !mantissa ) bits = sign;
+    else {
+      exponent = 113u;
+      while( !( mantissa & 0x400u ) ) {
+        mantissa <<= 1;
+        --exponent;
+      }
+      bits = sign | ( exponent << 23 ) | ( ( mantissa & 0x3FFu ) << 13 );
+    }
+    float result;
+    std::memcpy( &result, &bits, sizeof( result ) );
+    return result;
+#endif
+  }
+
+  inline uint16_t float_to_bfloat( float value ) {
+    uint32_t bits;
+    std::memcpy( &bits, &value, sizeof( bits ) );
+    if( ( bits & 0x7FFFFFFFu ) > 0x7F800000u ) return uint16_t( ( bits >> 16 ) | 0x40u );
+    return uint16_t( ( bits + 0x7FFFu + ( ( bits >> 16 ) & 1u ) ) >> 16 );
+  }
+
+  inline float bfloat_to_float( uint16_t value ) {
+    const uint32_t bits = uint32_t( value ) << 16;
+    float result;
+    std::memcpy( &result, &bits, sizeof( result ) );
+    return result;
+  }
+
+  class pixel_store {
+  public:
+    constexpr static size_t alignment = 64u;
+    constexpr static size_t lane_count = 8u;
+    pixel_store() : width( 0u ), height( 0u ), stride( 0u ), precision( pixel_precision::float32 ) {}
+    pixel_store( std::shared_ptr< void > data_, size_t width_, size_t height_, pixel_precision precision_ ) :
+      data( data_ ), width( width_ ), height( height_ ), stride( get_stride( width_, precision_ ) ), precision( precision_ ) {}
+    static size_t get_element_size( pixel_precision precision ) {
+      return precision == pixel_precision::float32 ? sizeof( float ) : sizeof( uint16_t );
+    }
+    static size_t get_stride( size_t width, pixel_precision precision ) {
+      const size_t per_line = alignment / get_element_size( precision );
+      return ( width + per_line - 1u ) / per_line * per_line;
+    }
+    static std::shared_ptr< void > allocate( size_t width, size_t height, pixel_precision precision ) {
+      void *p = nullptr;
+      const size_t size = std::max( get_stride( width, precision ) * height * get_element_size( precision ), alignment );
+      if( posix_memalign( &p, alignment, size ) ) return std::shared_ptr< void >();
+      std::memset( p, 0, size );
+      return std::shared_ptr< void >( p, &free );
+    }
+    static pixel_store create( const float *pixels, size_t width, size_t height, pixel_precision precision ) {
+      auto data = allocate( width, height, precision );
+      if( !data ) return pixel_store();
+      pixel_store store( data, width, height, precision );
+      for( size_t row = 0u; row != height; ++row ) {
+        const float *src = pixels + row * width;
+        if( precision == pixel_precision::float16 ) {
+          uint16_t *dest = static_cast< uint16_t* >( data.get() ) + row * store.stride;
+          for( size_t i = 0u; i != width; ++i )
+            dest[ i ] = float_to_half( src[ i ] );
+        }
+        else if( precision == pixel_precision::bfloat16 ) {
+          uint16_t *dest = static_cast< uint16_t* >( data.get() ) + row * store.stride;
+          for( size_t i = 0u; i != width; ++i )
+            dest[ i ] = float_to_bfloat( src[ i ] );
+        }
+        else
+          std::copy( src, src + width, static_cast< float* >( data.get() ) + row * store.stride );
+      }
+      return store;
+    }
+    pixel_store clone() const {
+      if( !data ) return pixel_store();
+      auto copied = allocate( width, height, precision );
+      if( !copied ) return pixel_store();
+      std::memcpy( copied.get(), data.get(), stride * height * get_element_size( precision ) );
+      return pixel_store( copied, width, height, precision );
+    }
+    float distance( const float *values, size_t row ) const {
+      if( precision == pixel_precision::float16 ) {
+        const uint16_t *r = static_cast< const uint16_t* >( data.get() ) + row * stride;
+        size_t i = 0u;
+        float sum = 0.f;
+#if defined(__F16C__) && defined(__AVX__)
+        const __m256 mask = _mm256_castsi256_ps( _mm256_set1_epi32( 0x7FFFFFFF ) );
+        __m256 acc = _mm256_setzero_ps();
+        for( ; i + lane_count <= width; i += lane_count ) {
+          const __m256 ref = _mm256_cvtph_ps( _mm_load_si128( reinterpret_cast< const __m128i* >( r + i ) ) );
+          acc = _mm256_add_ps( acc, _mm256_and_ps( _mm256_sub_ps( _mm256_loadu_ps( values + i ), ref ), mask ) );
+        }
+        float lanes[ lane_count ];
+        _mm256_storeu_ps( lanes, acc );
+        sum = ( ( lanes[ 0 ] + lanes[ 4 ] ) + ( lanes[ 1 ] + lanes[ 5 ] ) ) + ( ( lanes[ 2 ] + lanes[ 6 ] ) + ( lanes[ 3 ] + lanes[ 7 ] ) );
+#endif
+        for( ; i != width; ++i )
+          sum += std::abs( values[ i ] - half_to_float( r[ i ] ) );
+        return sum;
+      }
+      else if( precision == pixel_precision::bfloat16 ) {
+        const uint16_t *r = static_cast< const uint16_t* >( data.get() ) + row * stride;
+        float acc[ lane_count ] = {};
+        size_t i = 0u;
+        for( ; i + lane_count <= width; i += lane_count )
+          for( size_t j = 0u; j != lane_count; ++j )
+            acc[ j ] += std::abs( values[ i + j ] - bfloat_to_float( r[ i + j ] ) );
+        float sum = ( ( acc[ 0 ] + acc[ 4 ] ) + ( acc[ 1 ] + acc[ 5 ] ) ) + ( ( acc[ 2 ] + acc[ 6 ] ) + ( acc[ 3 ] + acc[ 7 ] ) );
+        for( ; i != width; ++i )
+          sum += std::abs( values[ i ] - bfloat_to_float( r[ i ] ) );
+        return sum;
+      }
+      else {
+        const float *r = static_cast< const float* >( data.get() ) + row * stride;
+        float acc[ lane_count ] = {};
+        size_t i = 0u;
+        for( ; i + lane_count <= width; i += lane_count )
+          for( size_t j = 0u; j != lane_count; ++j )
+            acc[ j ] += std::abs( values[ i + j ] - r[ i + j ] );
+        float sum = ( ( acc[ 0 ] + acc[ 4 ] ) + ( acc[ 1 ] + acc[ 5 ] ) ) + ( ( acc[ 2 ] + acc[ 6 ] ) + ( acc[ 3 ] + acc[ 7 ] ) );
+        for( ; i != width; ++i )
+          sum += std::abs( values[ i ] - r[ i ] );
+        return sum;
+      }
+    }
+    float sum( size_t row ) const {
+      float result = 0.f;
+      if( precision == pixel_precision::float16 ) {
+        const uint16_t *r = static_cast< const uint16_t* >( data.get() ) + row * stride;
+        for( size_t i = 0u; i != width; ++i )
+          result += half_to_float( r[ i ] );
+      }
+      else if( precision == pixel_precision::bfloat16 ) {
+        const uint16_t *r = static_cast< const uint16_t* >( data.get() ) + row * stride;
+        for( size_t i = 0u; i != width; ++i )
+          result += bfloat_to_float( r[ i ] );
+      }
+      else {
+        const float *r = static_cast< const float* >( data.get() ) + row * stride;
+        for( size_t i = 0u; i != width; ++i )
+          result += r[ i ];
+      }
+      return result;
+    }
+    const void *get_data() const { return data.get(); }
+    size_t get_width() const { return width; }
+    size_t get_height() const { return height; }
+    size_t get_stride() const { return stride; }
+    pixel_precision get_precision() const { return precision; }
+    bool empty() const { return !data; }
+  private:
+    std::shared_ptr< void > data;
+    size_t width;
+    size_t height;
+    size_t stride;
+    pixel_precision precision;
+  };
+}
+
+#endif
+
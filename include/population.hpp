@@ -0,0 +1,47 @@
+#ifndef WAV2IMAGE_POPULATION_H
+#define WAV2IMAGE_POPULATION_H
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <random>
+
+#include "genome_schema.hpp"
+
+class population {
+public:
+  constexpr static size_t gene_count = tinyfm3::genome_size;
+  constexpr static size_t config_size = tinyfm3::config_size;
+  population( size_t capacity_, const tinyfm3::genome_schema &schema_ );
+  void generate( size_t size, std::mt19937 &random_generator );
+  const float *decode( float release, bool has_release );
+  std::vector< float > get_config( size_t i ) const;
+  void set( size_t i, const uint32_t *genome );
+  void get_parameters( size_t i, float *dest ) const;
+  double select( size_t survive_count, size_t elite_count, std::mt19937 &random_generator, size_t &top_index );
+  void breed( int mutation_rate, std::mt19937 &random_generator );
+  void clear_cache();
+  size_t size() const { return count; }
+  bool is_cached( size_t i ) const { return cached[ i ]; }
+  double *get_scores() { return scores.data(); }
+  const double *get_scores() const { return scores.data(); }
+private:
+  uint32_t *get_genes( size_t buffer, size_t gene ) { return genes[ buffer ].data() + gene * capacity; }
+  const uint32_t *get_genes( size_t buffer, size_t gene ) const { return genes[ buffer ].data() + gene * capacity; }
+  tinyfm3::genome_schema schema;
+  size_t capacity;
+  size_t count;
+  size_t current;
+  std::array< std::vector< uint32_t >, 2u > genes;
+  std::vector< double > scores;
+  std::vector< uint8_t > cached;
+  std::vector< uint8_t > taken;
+  std::vector< double > weights;
+  std::vector< size_t > survivors;
+  std::vector< double > survivor_scores;
+  std::vector< uint32_t > bits;
+  std::vector< float > configs;
+};
+
+#endif
+
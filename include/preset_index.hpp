@@ -0,0 +1,32 @@
+#ifndef WAV2IMAGE_PRESET_INDEX_HPP
+#define WAV2IMAGE_PRESET_INDEX_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "fft.hpp"
+
+bool load_config( const std::string &filename, std::vector< float > &config );
+
+class preset_index {
+public:
+  constexpr static size_t spectrum_size = 32u;
+  constexpr static size_t envelope_size = 16u;
+  struct entry {
+    std::string name;
+    std::vector< float > fingerprint;
+    std::vector< float > config;
+  };
+  static std::vector< float > fingerprint( const window_list_t &window, const std::vector< int16_t > &audio );
+  void add( const std::string &name, std::vector< float > &&fingerprint, const std::vector< float > &config );
+  bool load( const std::string &filename );
+  bool save( const std::string &filename ) const;
+  std::vector< const entry* > nearest( const std::vector< float > &fingerprint, size_t count ) const;
+  size_t size() const { return entries.size(); }
+private:
+  std::vector< entry > entries;
+};
+
+#endif
+
@@ -0,0 +1,180 @@
+#ifndef TINYFM3_REAL_FFT_HPP
+#define TINYFM3_REAL_FFT_HPP
+
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+namespace tinyfm3 {
+  namespace detail {
+    template< size_t len, size_t stride, bool eo >
+    struct stockham {
+      static void run( float *xr, float *xi, float *yr, float *yi, const float *twiddle ) {
+        constexpr size_t n1 = len / 4u;
+        constexpr size_t n2 = len / 2u;
+        constexpr size_t n3 = n1 + n2;
+        const float *w1r = twiddle;
+        const float *w1i = w1r + n1;
+        const float *w2r = w1i + n1;
+        const float *w2i = w2r + n1;
+        const float *w3r = w2i + n1;
+        const float *w3i = w3r + n1;
+        for( size_t p = 0u; p != n1; ++p ) {
+          for( size_t q = 0u; q != stride; ++q ) {
+            const float ar = xr[ q + stride * p ];
+            const float ai = xi[ q + stride * p ];
+            const float br = xr[ q + stride * ( p + n1 ) ];
+            const float bi = xi[ q + stride * ( p + n1 ) ];
+            const float cr = xr[ q + stride * ( p + n2 ) ];
+            const float ci = xi[ q + stride * ( p + n2 ) ];
+            const float dr = xr[ q + stride * ( p + n3 ) ];
+            const float di = xi[ q + stride * ( p + n3 ) ];
+            const float apcr = ar + cr;
+            const float apci = ai + ci;
+            const float amcr = ar - cr;
+            const float amci = ai - ci;
+            const float bpdr = br + dr;
+            const float bpdi = bi + di;
+            const float jbmdr = di - bi;
+            const float jbmdi = br - dr;
+            yr[ q + stride * ( 4u * p ) ] = apcr + bpdr;
+            yi[ q + stride * ( 4u * p ) ] = apci + bpdi;
+            const float t1r = amcr - jbmdr;
+            const float t1i = amci - jbmdi;
+            yr[ q + stride * ( 4u * p + 1u ) ] = t1r * w1r[ p ] - t1i * w1i[ p ];
+            yi[ q + stride * ( 4u * p + 1u ) ] = t1r * w1i[ p ] + t1i * w1r[ p ];
+            const float t2r = apcr - bpdr;
+            const float t2i = apci - bpdi;
+            yr[ q + stride * ( 4u * p + 2u ) ] = t2r * w2r[ p ] - t2i * w2i[ p ];
+            yi[ q + stride * ( 4u * p + 2u ) ] = t2r * w2i[ p ] + t2i * w2r[ p ];
+            const float t3r = amcr + jbmdr;
+            const float t3i = amci + jbmdi;
+            yr[ q + stride * ( 4u * p + 3u ) ] = t3r * w3r[ p ] - t3i * w3i[ p ];
+            yi[ q + stride * ( 4u * p + 3u ) ] = t3r * w3i[ p ] + t3i * w3r[ p ];
+          }
+        }
+        stockham< len / 4u, stride * 4u, !eo >::run( yr, yi, xr, xi, twiddle + 6u * n1 );
+      }
+    };
+    template< size_t stride, bool eo >
+    struct stockham< 2u, stride, eo > {
+      static void run( float *xr, float *xi, float *yr, float *yi, const float* ) {
+        for( size_t q = 0u; q != stride; ++q ) {
+          const float ar = xr[ q ];
+          const float ai = xi[ q ];
+          const float br = xr[ q + stride ];
+          const float bi = xi[ q + stride ];
+          yr[ q ] = ar + br;
+          yi[ q ] = ai + bi;
+          yr[ q + stride ] = ar - br;
+          yi[ q + stride ] = ai - bi;
+        }
+        stockham< 1u, stride * 2u, !eo >::run( yr, yi, xr, xi, nullptr );
+      }
+    };
+    template< size_t stride, bool eo >
+    struct stockham< 1u, stride, eo > {
+      static void run( float *xr, float *xi, float *yr, float *yi, const float* ) {
+        if( eo ) {
+          std::copy( xr, xr + stride, yr );
+          std::copy( xi, xi + stride, yi );
+        }
+      }
+    };
+  }
+
+  class real_fft_base {
+  public:
+    virtual ~real_fft_base() {}
+    virtual float *get_input() = 0;
+    virtual void operator()( float *magnitudes, size_t width ) = 0;
+  };
+
+  template< size_t n >
+  class real_fft : public real_fft_base {
+    static_assert( n >= 4u && !( n & ( n - 1u ) ), "n must be a power of two" );
+    constexpr static size_t m = n / 2u;
+  public:
+    real_fft() : input( n ), xr( m ), xi( m ), yr( m ), yi( m ) {}
+    float *get_input() override { return input.data(); }
+    void operator()( float *magnitudes, size_t width ) override {
+      for( size_t k = 0u; k != m; ++k ) {
+        xr[ k ] = input[ 2u * k ];
+        xi[ k ] = input[ 2u * k + 1u ];
+      }
+      const auto &t = get_tables();
+      detail::stockham< m, 1u, false >::run( xr.data(), xi.data(), yr.data(), yi.data(), t.stages.data() );
+      width = std::min( width, m + 1u );
+      for( size_t k = 0u; k != width; ++k ) {
+        const size_t l = ( m - k ) & ( m - 1u );
+        const size_t j = k & ( m - 1u );
+        const float er = 0.5f * ( xr[ j ] + xr[ l ] );
+        const float ei = 0.5f * ( xi[ j ] - xi[ l ] );
+        const float or_ = 0.5f * ( xi[ j ] + xi[ l ] );
+        const float oi = -0.5f * ( xr[ j ] - xr[ l ] );
+        const float re = er + or_ * t.post_r[ k ] - oi * t.post_i[ k ];
+        const float im = ei + or_ * t.post_i[ k ] + oi * t.post_r[ k ];
+        magnitudes[ k ] = std::sqrt( re * re + im * im );
+      }
+    }
+  private:
+    struct tables {
+      tables() : post_r( m + 1u ), post_i( m + 1u ) {
+        size_t len = m;
+        size_t stride = 1u;
+        for( ; len >= 4u; len /= 4u, stride *= 4u ) {
+          const size_t n1 = len / 4u;
+          const size_t offset = stages.size();
+          stages.resize( offset + 6u * n1 );
+          for( size_t p = 0u; p != n1; ++p ) {
+            for( size_t r = 1u; r != 4u; ++r ) {
+              const double theta = -2.0 * M_PI * double( r * p ) / double( len );
+              stages[ offset + ( 2u * r - 2u ) * n1 + p ] = float( std::cos( theta ) );
+              stages[ offset + ( 2u * r - 1u ) * n1 + p ] = float( std::sin( theta ) );
+            }
+          }
+        }
+        for( size_t k = 0u; k != m + 1u; ++k ) {
+          const double theta = -2.0 * M_PI * double( k ) / double( n );
+          post_r[ k ] = float( std::cos( theta ) );
+          post_i[ k ] = float( std::sin( theta ) );
+        }
+      }
+      std::vector< float > stages;
+      std::vector< float > post_r;
+      std::vector< float > post_i;
+    };
+    static const tables &get_tables() {
+      static const tables instance;
+      return instance;
+    }
+    std::vector< float > input;
+    std::vector< float > xr;
+    std::vector< float > xi;
+    std::vector< float > yr;
+    std::vector< float > yi;
+  };
+
+  inline std::unique_ptr< real_fft_base > make_real_fft( size_t n ) {
+    switch( n ) {
+      case 16u: return std::unique_ptr< real_fft_base >( new real_fft< 16u >() );
+      case 32u: return std::unique_ptr< real_fft_base >( new real_fft< 32u >() );
+      case 64u: return std::unique_ptr< real_fft_base >( new real_fft< 64u >() );
+      case 128u: return std::unique_ptr< real_fft_base >( new real_fft< 128u >() );
+      case 256u: return std::unique_ptr< real_fft_base >( new real_fft< 256u >() );
+      case 512u: return std::unique_ptr< real_fft_base >( new real_fft< 512u >() );
+      case 1024u: return std::unique_ptr< real_fft_base >( new real_fft< 1024u >() );
+      case 2048u: return std::unique_ptr< real_fft_base >( new real_fft< 2048u >() );
+      case 4096u: return std::unique_ptr< real_fft_base >( new real_fft< 4096u >() );
+      case 8192u: return std::unique_ptr< real_fft_base >( new real_fft< 8192u >() );
+      case 16384u: return std::unique_ptr< real_fft_base >( new real_fft< 16384u >() );
+      case 32768u: return std::unique_ptr< real_fft_base >( new real_fft< 32768u >() );
+      default: return std::unique_ptr< real_fft_base >();
+    }
+  }
+}
+
+#endif
+
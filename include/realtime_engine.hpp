@@ -0,0 +1,165 @@
+#ifndef TINYFM3_REALTIME_ENGINE_HPP
+#define TINYFM3_REALTIME_ENGINE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "common.hpp"
+#include "normalizer.hpp"
+#include "midi_player.hpp"
+#include "spsc_ring.hpp"
+
+namespace tinyfm3 {
+  class output_backend {
+  public:
+    virtual ~output_backend() {}
+    virtual void operator()( const float *data, size_t size ) = 0;
+  };
+
+  class null_output : public output_backend {
+  public:
+    void operator()( const float*, size_t ) override {}
+  };
+
+  struct realtime_stats {
+    realtime_stats() : blocks( 0u ), rendered( 0u ), underruns( 0u ), events( 0u ), latency_count( 0u ), latency_sum( 0.0 ), latency_max( 0.0 ), render_sum( 0.0 ), render_max( 0.0 ) {}
+    size_t blocks;
+    size_t rendered;
+    size_t underruns;
+    size_t events;
+    size_t latency_count;
+    double latency_sum;
+    double latency_max;
+    double render_sum;
+    double render_max;
+  };
+
+  class realtime_engine {
+  public:
+    using clock = std::chrono::steady_clock;
+    constexpr static size_t max_block_count = 64u;
+    realtime_engine( output_backend &output_, size_t block_size_, size_t block_count_ ) :
+      output( output_ ), player( new midi_player() ),
+      block_size( std::max( block_size_, size_t( 1u ) ) ),
+      block_count( std::min( std::max( block_count_, size_t( 2u ) ), max_block_count ) ),
+      storage( block_size * block_count ), level( block_size ), silence( block_size ),
+      blocks( block_count ), running( false ) {
+      for( size_t i = 0u; i != block_count; ++i ) {
+        blocks[ i ].data = std::next( storage.data(), i * block_size );
+        free_blocks.push( i );
+      }
+    }
+    ~realtime_engine() {
+      stop();
+    }
+    bool push( uint8_t value ) {
+      return input.push( midi_input{ value, clock::now() } );
+    }
+    void start() {
+      if( running.exchange( true ) ) return;
+      renderer = std::thread( [this]() { render_loop(); } );
+      sender = std::thread( [this]() { output_loop(); } );
+    }
+    void stop() {
+      if( !running.exchange( false ) ) return;
+      renderer.join();
+      sender.join();
+    }
+    const realtime_stats &get_stats() const { return stats; }
+    clock::duration get_block_period() const {
+      return std::chrono::duration_cast< clock::duration >( std::chrono::duration< double >( double( block_size ) / frequency ) );
+    }
+  private:
+    struct midi_input {
+      uint8_t value;
+      clock::time_point time;
+    };
+    struct block {
+      float *data;
+      bool has_event;
+      clock::time_point first_event;
+    };
+    void render_loop() {
+      const auto period = get_block_period();
+      while( running.load( std::memory_order_acquire ) ) {
+        size_t index;
+        if( !free_blocks.pop( index ) ) {
+          std::this_thread::sleep_for( period / 4 );
+          continue;
+        }
+        auto &b = blocks[ index ];
+        b.has_event = false;
+        midi_input in;
+        while( input.pop( in ) ) {
+          if( !b.has_event ) {
+            b.first_event = in.time;
+            b.has_event = true;
+          }
+          player->event( in.value );
+          ++stats.events;
+        }
+        const auto begin = clock::now();
+        ( *player )( b.data, std::next( b.data, block_size ), level.begin() );
+        for( size_t i = 0u; i != block_size; ++i )
+          b.data[ i ] *= norm( 1.f, level[ i ] );
+        const double render_time = std::chrono::duration< double >( clock::now() - begin ).count();
+        stats.render_sum += render_time;
+        stats.render_max = std::max( stats.render_max, render_time );
+        ++stats.rendered;
+        filled_blocks.push( index );
+      }
+    }
+    void output_loop() {
+      const auto period = get_block_period();
+      while( running.load( std::memory_order_acquire ) && filled_blocks.empty() )
+        std::this_thread::yield();
+      auto next = clock::now();
+      while( running.load( std::memory_order_acquire ) ) {
+        size_t index;
+        if( filled_blocks.pop( index ) ) {
+          const auto &b = blocks[ index ];
+          output( b.data, block_size );
+          if( b.has_event ) {
+            const double latency = std::chrono::duration< double >( clock::now() - b.first_event ).count();
+            stats.latency_sum += latency;
+            stats.latency_max = std::max( stats.latency_max, latency );
+            ++stats.latency_count;
+          }
+          free_blocks.push( index );
+          ++stats.blocks;
+        }
+        else {
+          output( silence.data(), block_size );
+          ++stats.underruns;
+        }
+        next += period;
+        std::this_thread::sleep_until( next );
+      }
+    }
+    output_backend &output;
+    std::unique_ptr< midi_player > player;
+    normalizer norm;
+    size_t block_size;
+    size_t block_count;
+    std::vector< float > storage;
+    std::vector< float > level;
+    std::vector< float > silence;
+    std::vector< block > blocks;
+    spsc_ring< midi_input, 4096u > input;
+    spsc_ring< size_t, max_block_count > free_blocks;
+    spsc_ring< size_t, max_block_count > filled_blocks;
+    realtime_stats stats;
+    std::atomic< bool > running;
+    std::thread renderer;
+    std::thread sender;
+  };
+}
+
+#endif
+
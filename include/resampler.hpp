@@ -0,0 +1,80 @@
+#ifndef TINYFM3_RESAMPLER_HPP
+#define TINYFM3_RESAMPLER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+namespace tinyfm3 {
+  class polyphase_resampler {
+  public:
+    constexpr static size_t lane_count = 8u;
+    polyphase_resampler( uint32_t input_rate, uint32_t output_rate, size_t taps_ = 32u ) :
+      taps( std::max( ( taps_ + lane_count - 1u ) / lane_count * lane_count, size_t( lane_count ) ) ),
+      index( 0u ), phase( 0u ) {
+      const uint32_t divisor = gcd( input_rate, output_rate );
+      up = output_rate / divisor;
+      down = input_rate / divisor;
+      const size_t length = taps * up;
+      const double cutoff = 0.5 * 0.95 / std::max( up, down );
+      const double center = ( length - 1 ) * 0.5;
+      coefficients.resize( length );
+      for( size_t p = 0u; p != up; ++p ) {
+        for( size_t j = 0u; j != taps; ++j ) {
+          const size_t n = p + ( taps - 1u - j ) * up;
+          const double x = n - center;
+          const double sinc = ( x == 0.0 ) ? 1.0 : std::sin( 2.0 * M_PI * cutoff * x ) / ( 2.0 * M_PI * cutoff * x );
+          const double w = 2.0 * M_PI * n / ( length - 1 );
+          const double window = 0.42 - 0.5 * std::cos( w ) + 0.08 * std::cos( 2.0 * w );
+          coefficients[ p * taps + j ] = float( 2.0 * cutoff * up * sinc * window );
+        }
+      }
+      buffer.assign( taps - 1u, 0.f );
+    }
+    bool is_identity() const { return up == down; }
+    void operator()( const float *input, size_t size, std::vector< float > &output ) {
+      buffer.insert( buffer.end(), input, std::next( input, size ) );
+      while( index + taps <= buffer.size() ) {
+        output.push_back( dot( &coefficients[ phase * taps ], &buffer[ index ] ) );
+        phase += down;
+        index += phase / up;
+        phase %= up;
+      }
+      const size_t consumed = std::min( index, buffer.size() );
+      buffer.erase( buffer.begin(), std::next( buffer.begin(), consumed ) );
+      index -= consumed;
+    }
+    void flush( std::vector< float > &output ) {
+      const std::vector< float > silence( taps / 2u, 0.f );
+      ( *this )( silence.data(), silence.size(), output );
+    }
+  private:
+    static uint32_t gcd( uint32_t a, uint32_t b ) {
+      while( b ) {
+        const uint32_t t = a % b;
+        a = b;
+        b = t;
+      }
+      return a;
+    }
+    float dot( const float *coeff, const float *x ) const {
+      float acc[ lane_count ] = {};
+      for( size_t k = 0u; k != taps; k += lane_count )
+        for( size_t j = 0u; j != lane_count; ++j )
+          acc[ j ] += coeff[ k + j ] * x[ k + j ];
+      return ( ( acc[ 0 ] + acc[ 4 ] ) + ( acc[ 1 ] + acc[ 5 ] ) ) + ( ( acc[ 2 ] + acc[ 6 ] ) + ( acc[ 3 ] + acc[ 7 ] ) );
+    }
+    size_t taps;
+    uint32_t up;
+    uint32_t down;
+    size_t index;
+    size_t phase;
+    std::vector< float > coefficients;
+    std::vector< float > buffer;
+  };
+}
+
+#endif
+
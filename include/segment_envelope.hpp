@@ -1,9 +1,11 @@
 #ifndef WAV2IMAGE_SEGMENT_ENVELOPE_H
 #define WAV2IMAGE_SEGMENT_ENVELOPE_H
 
+#include <cstddef>
 #include <vector>
 #include <tuple>
 
+std::tuple< int, int, int > segment_envelope( const float *input, size_t size, float a, float b );
 std::tuple< int, int, int > segment_envelope( const std::vector< float > &input, float a, float b );
 
 #endif
@@ -5,6 +5,9 @@
 #include <vector>
 
 #include "fft.hpp"
+#include "filterbank.hpp"
+#include "frame_table.hpp"
+#include "pixel_store.hpp"
 
 class spectrum_image {
 public:
@@ -16,10 +19,21 @@ public:
     uint32_t resolution_,
     uint32_t scale_,
     int weight,
-    unsigned int interval
+    unsigned int interval,
+    bool quantized = false,
+    size_t band_count = 0u,
+    tinyfm3::band_scale band = tinyfm3::band_scale::mel,
+    tinyfm3::pixel_precision precision = tinyfm3::pixel_precision::float32
   );
+  spectrum_image replicate() const;
   const std::vector< float > &get_envelope() const { return envelope; }
-  const float *get_pixels() const { return pixels_begin; }
+  const tinyfm3::pixel_store &get_store() const { return store; }
+  const uint8_t *get_levels() const { return levels.get(); }
+  bool is_quantized() const { return bool( levels ); }
+  const tinyfm3::filterbank *get_filterbank() const { return bank.get(); }
+  const float *get_bands() const { return bands.data(); }
+  const tinyfm3::frame_table &get_frames() const { return frames; }
+  size_t get_band_count() const { return bank ? bank->get_band_count() : size_t( x ); }
   int get_delay() const { return delay; }
   int get_attack() const { return attack; }
   int get_release() const { return release; }
@@ -38,6 +52,11 @@ private:
   std::vector< float > envelope;
   std::shared_ptr< float > pixels;
   float *pixels_begin;
+  tinyfm3::pixel_store store;
+  std::shared_ptr< uint8_t > levels;
+  std::shared_ptr< tinyfm3::filterbank > bank;
+  std::vector< float > bands;
+  tinyfm3::frame_table frames;
   int delay;
   int attack;
   int release;
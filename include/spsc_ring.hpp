@@ -0,0 +1,42 @@
+#ifndef TINYFM3_SPSC_RING_HPP
+#define TINYFM3_SPSC_RING_HPP
+
+#include <cstddef>
+#include <atomic>
+#include <array>
+
+namespace tinyfm3 {
+  template< typename T, size_t capacity >
+  class spsc_ring {
+    static_assert( capacity && !( capacity & ( capacity - 1u ) ), "capacity must be a power of two" );
+  public:
+    spsc_ring() : head( 0u ), tail( 0u ) {}
+    bool push( const T &value ) {
+      const size_t h = head.load( std::memory_order_relaxed );
+      if( h - tail.load( std::memory_order_acquire ) == capacity ) return false;
+      data[ h & ( capacity - 1u ) ] = value;
+      head.store( h + 1u, std::memory_order_release );
+      return true;
+    }
+    bool pop( T &value ) {
+      const size_t t = tail.load( std::memory_order_relaxed );
+      if( head.load( std::memory_order_acquire ) == t ) return false;
+      value = data[ t & ( capacity - 1u ) ];
+      tail.store( t + 1u, std::memory_order_release );
+      return true;
+    }
+    size_t size() const {
+      return head.load( std::memory_order_acquire ) - tail.load( std::memory_order_acquire );
+    }
+    bool empty() const { return size() == 0u; }
+  private:
+    std::atomic< size_t > head;
+    char head_padding[ 64u - sizeof( std::atomic< size_t > ) ];
+    std::atomic< size_t > tail;
+    char tail_padding[ 64u - sizeof( std::atomic< size_t > ) ];
+    std::array< T, capacity > data;
+  };
+}
+
+#endif
+
@@ -0,0 +1,27 @@
+#ifndef WAV2IMAGE_SURROGATE_MODEL_H
+#define WAV2IMAGE_SURROGATE_MODEL_H
+
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+class surrogate_model {
+public:
+  surrogate_model( size_t dimension_, size_t capacity_, size_t neighbor_count_ );
+  void add( const float *features, double value );
+  double predict( const float *features ) const;
+  void clear();
+  size_t size() const { return count; }
+private:
+  size_t dimension;
+  size_t capacity;
+  size_t neighbor_count;
+  size_t count;
+  size_t head;
+  std::vector< float > features;
+  std::vector< double > values;
+  mutable std::vector< std::pair< float, size_t > > nearest;
+};
+
+#endif
+
@@ -0,0 +1,54 @@
+#ifndef TINYFM3_VOICE_TABLE_HPP
+#define TINYFM3_VOICE_TABLE_HPP
+
+#include <cstdint>
+#include <array>
+#include <iterator>
+#include <initializer_list>
+#include <algorithm>
+
+#include "common.hpp"
+#include "fm_operator.hpp"
+
+namespace tinyfm3 {
+  class voice_table {
+  public:
+    constexpr static size_t key_count = 128u;
+    voice_table() {}
+    template< typename Iterator >
+    voice_table( Iterator begin, Iterator end ) {
+      reset( begin, end );
+    }
+    template< typename Iterator >
+    void reset( Iterator begin, Iterator end ) {
+      if( begin == end ) throw invalid_configuration();
+      for( size_t key = 0u; key != key_count; ++key ) {
+        auto right = std::find_if( begin, end, [&]( decltype( *begin ) split ) { return split.first > key; } );
+        if( right == begin || right == end ) {
+          const auto &split = ( right == begin ) ? *begin : *std::prev( end );
+          keys[ key ].reset( uint8_t( key ), split.second.begin(), split.second.end() );
+        }
+        else {
+          const auto &left = *std::prev( right );
+          const float pos = float( key - left.first ) / float( right->first - left.first );
+          std::array< float, 70u > config;
+          for( size_t i = 0u; i != config.size(); ++i )
+            config[ i ] = left.second[ i ] * ( 1.f - pos ) + right->second[ i ] * pos;
+          for( size_t i = 0u; i != 4u; ++i ) {
+            const size_t offset = size_t( fm_config::index_t::operator0 ) + i * 16u;
+            for( const auto index: { fm_operator_config::index_t::freq, fm_operator_config::index_t::func } )
+              config[ offset + size_t( index ) ] = ( pos < 0.5f ? left : *right ).second[ offset + size_t( index ) ];
+          }
+          keys[ key ].reset( uint8_t( key ), config.begin(), config.end() );
+        }
+      }
+    }
+    const key_voice &operator[]( scale_t key ) const {
+      return keys[ std::min( size_t( key ), key_count - 1u ) ];
+    }
+  private:
+    std::array< key_voice, key_count > keys;
+  };
+}
+
+#endif
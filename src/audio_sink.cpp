@@ -0,0 +1,124 @@
+#include <cstdlib>
+#include <new>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+#include <sndfile.h>
+
+#include "common.hpp"
+#include "audio_sink.hpp"
+
+namespace tinyfm3 {
+  bool parse_sample_format( const std::string &name, sample_format &format ) {
+    if( name == "pcm16" ) format = sample_format::pcm16;
+    else if( name == "float32" ) format = sample_format::float32;
+    else return false;
+    return true;
+  }
+  namespace {
+    template< typename T >
+    T *allocate_aligned( size_t count ) {
+      void *ptr = nullptr;
+      if( posix_memalign( &ptr, 64u, count * sizeof( T ) ) ) throw std::bad_alloc();
+      return reinterpret_cast< T* >( ptr );
+    }
+  }
+  audio_sink::audio_sink( const std::string &filename, sample_format format_ ) :
+    file( nullptr ), fd( -1 ), format( format_ ),
+    storage( allocate_aligned< float >( block_size * block_count ), &std::free ),
+    converted( allocate_aligned< int16_t >( block_size ), &std::free ),
+    current( storage.get() ), filled( 0u ), stall_count( 0u ), stall_time( 0.0 ),
+    closing( false ), failed( false ) {
+    if( filename == "-" ) fd = STDOUT_FILENO;
+    else {
+      SF_INFO config;
+      config.frames = 0;
+      config.samplerate = frequency;
+      config.channels = 1;
+      config.format = SF_FORMAT_WAV|( format == sample_format::pcm16 ? SF_FORMAT_PCM_16 : SF_FORMAT_FLOAT );
+      config.sections = 0;
+      config.seekable = 1;
+      file = sf_open( filename.c_str(), SFM_WRITE, &config );
+      if( !file ) {
+        std::cerr << "Unable to open audio file" << std::endl;
+        throw -1;
+      }
+    }
+    for( size_t i = 1u; i != block_count; ++i )
+      free_blocks.push( std::next( storage.get(), i * block_size ) );
+    writer = std::thread( [this]() { run(); } );
+  }
+  audio_sink::~audio_sink() {
+    close();
+  }
+  void audio_sink::close() {
+    if( !writer.joinable() ) return;
+    if( filled ) {
+      filled_blocks.push( block{ current, filled } );
+      filled = 0u;
+    }
+    closing.store( true, std::memory_order_release );
+    writer.join();
+    if( file ) {
+      auto sndfile = reinterpret_cast< SNDFILE* >( file );
+      sf_write_sync( sndfile );
+      sf_close( sndfile );
+      file = nullptr;
+    }
+  }
+  void audio_sink::report( const std::string &name ) const {
+    if( !good() )
+      std::cerr << name << ": write failed" << std::endl;
+    if( stall_count )
+      std::cerr << name << ": " << stall_count << " write stalls, " << stall_time << " s" << std::endl;
+  }
+  void audio_sink::submit() {
+    filled_blocks.push( block{ current, filled } );
+    filled = 0u;
+    acquire();
+  }
+  void audio_sink::acquire() {
+    if( free_blocks.pop( current ) ) return;
+    ++stall_count;
+    const auto begin = std::chrono::steady_clock::now();
+    while( !free_blocks.pop( current ) )
+      std::this_thread::yield();
+    stall_time += std::chrono::duration< double >( std::chrono::steady_clock::now() - begin ).count();
+  }
+  void audio_sink::run() {
+    while( 1 ) {
+      block b;
+      if( filled_blocks.pop( b ) ) {
+        if( good() && !write( b.data, b.size ) )
+          failed.store( true, std::memory_order_release );
+        free_blocks.push( b.data );
+      }
+      else if( closing.load( std::memory_order_acquire ) ) {
+        if( filled_blocks.empty() ) break;
+      }
+      else std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+    }
+  }
+  bool audio_sink::write( const float *data, size_t size ) {
+    const char *bytes = reinterpret_cast< const char* >( data );
+    size_t byte_count = size * sizeof( float );
+    if( format == sample_format::pcm16 ) {
+      std::transform( data, std::next( data, size ), converted.get(), []( float value ) {
+        return int16_t( std::min( std::max( value, -1.f ), 1.f ) * 32767 );
+      } );
+      if( file ) return sf_write_short( reinterpret_cast< SNDFILE* >( file ), converted.get(), size ) == sf_count_t( size );
+      bytes = reinterpret_cast< const char* >( converted.get() );
+      byte_count = size * sizeof( int16_t );
+    }
+    else if( file ) return sf_write_float( reinterpret_cast< SNDFILE* >( file ), data, size ) == sf_count_t( size );
+    while( byte_count ) {
+      const auto written = ::write( fd, bytes, byte_count );
+      if( written <= 0 ) return false;
+      bytes += written;
+      byte_count -= written;
+    }
+    return true;
+  }
+}
+
@@ -0,0 +1,91 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <boost/program_options.hpp>
+#include "common.hpp"
+#include "fft.hpp"
+#include "generate_tone.hpp"
+#include "preset_index.hpp"
+
+bool is_directory( const std::string &path ) {
+  struct stat buf;
+  return stat( path.c_str(), &buf ) == 0 && S_ISDIR( buf.st_mode );
+}
+
+void find_configs( const std::string &path, std::vector< std::string > &files ) {
+  DIR *dir = opendir( path.c_str() );
+  if( !dir ) return;
+  std::vector< std::string > names;
+  while( const auto entry = readdir( dir ) ) {
+    const std::string name = entry->d_name;
+    if( name.empty() || name[ 0 ] == '.' ) continue;
+    names.push_back( name );
+  }
+  closedir( dir );
+  std::sort( names.begin(), names.end() );
+  for( const auto &name: names ) {
+    const std::string full = path + "/" + name;
+    if( is_directory( full ) ) find_configs( full, files );
+    else if( name.size() > 5u && name.compare( name.size() - 5u, 5u, ".conf" ) == 0 ) files.push_back( full );
+  }
+}
+
+int main( int argc, char* argv[] ) {
+  boost::program_options::options_description options("オプション");
+  options.add_options()
+    ("help,h",    "ヘルプを表示")
+    ("input,i", boost::program_options::value<std::string>(),  "過去の探索結果(.conf)を含むディレクトリ")
+    ("output,o", boost::program_options::value<std::string>(),  "出力するインデックスファイル")
+    ("append,a",    "既存のインデックスに追加")
+    ("note,n", boost::program_options::value<int>()->default_value(60),  "音階")
+    ("length,l", boost::program_options::value<float>()->default_value(1.5f),  "長さ")
+    ("release,r", boost::program_options::value<float>()->default_value(1.f),  "ノートオフまでの時間");
+  boost::program_options::variables_map params;
+  boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
+  boost::program_options::notify( params );
+  if( params.count("help") || !params.count("input") || !params.count("output") ) {
+    std::cout << options << std::endl;
+    return 0;
+  }
+  const std::string input_dir = params["input"].as<std::string>();
+  const std::string output_filename = params["output"].as<std::string>();
+  const int note = params["note"].as<int>();
+  const int total_length = params["length"].as<float>() * tinyfm3::frequency;
+  const int release = params["release"].as<float>() * tinyfm3::frequency;
+  if( release >= total_length ) {
+    std::cerr << "Invalid length" << std::endl;
+    return -1;
+  }
+  if( !is_directory( input_dir ) ) {
+    std::cerr << "Invalid input directory" << std::endl;
+    return -1;
+  }
+  preset_index index;
+  if( params.count("append") && !index.load( output_filename ) ) {
+    std::cerr << "Unable to load " << output_filename << std::endl;
+    return -1;
+  }
+  init_fft();
+  const auto window = generate_window();
+  std::vector< std::string > files;
+  find_configs( input_dir, files );
+  std::vector< float > config;
+  for( const auto &filename: files ) {
+    if( !load_config( filename, config ) ) {
+      std::cerr << "Skipped " << filename << std::endl;
+      continue;
+    }
+    const auto audio = generate_tone( note, 0, release, total_length, config, true );
+    index.add( filename, preset_index::fingerprint( window, audio ), config );
+  }
+  if( !index.save( output_filename ) ) {
+    std::cerr << "Unable to write " << output_filename << std::endl;
+    return -1;
+  }
+  std::cout << index.size() << " presets" << std::endl;
+  return 0;
+}
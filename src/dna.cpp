@@ -13,6 +13,9 @@
 dna::dna() {
   std::random_device seed_generator;
   std::mt19937 random_generator( seed_generator() );
+  *this = dna( random_generator );
+}
+dna::dna( std::mt19937 &random_generator ) {
   std::uniform_int_distribution< uint32_t > distribution( 0u, std::numeric_limits< uint32_t >::max() );
   for( uint32_t &v : data ) v = distribution( random_generator );
   data[ 4 ] |= 0xC0000000;
@@ -143,6 +146,9 @@ std::vector< float > dna::operator()( float attack, float release, bool has_rele
 dna dna::crossover( const dna &r, int mutation_rate ) const {
   std::random_device seed_generator;
   std::mt19937 random_generator( seed_generator() );
+  return crossover( r, mutation_rate, random_generator );
+}
+dna dna::crossover( const dna &r, int mutation_rate, std::mt19937 &random_generator ) const {
   std::uniform_int_distribution< uint32_t > distribution( 0u, std::numeric_limits< uint32_t >::max() );
   std::array< uint32_t, 56u > generated;
   for( size_t i = 0u; i != data.size(); ++i ) {
@@ -0,0 +1,61 @@
+#include <vector>
+#include <memory>
+#include <string>
+
+#include "fft.hpp"
+#include "fft_host.hpp"
+#include "real_fft.hpp"
+
+class builtin_transform {
+public:
+  builtin_transform( size_t resolution ) : transform( tinyfm3::make_real_fft( resolution ) ) {
+    if( !transform ) throw fft_initialization_failed( "unsupported resolution " + std::to_string( resolution ) );
+  }
+  float *get_input() { return transform->get_input(); }
+  void operator()( float *magnitudes, size_t width ) {
+    ( *transform )( magnitudes, width );
+  }
+private:
+  std::unique_ptr< tinyfm3::real_fft_base > transform;
+};
+
+void init_fft( unsigned int ) {
+}
+
+window_list_t generate_window() {
+  return tinyfm3::host::generate_window();
+}
+
+std::pair< std::vector< float >, std::shared_ptr< float > > fftref( const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  return tinyfm3::host::reference< builtin_transform >( window, frames, data, width );
+}
+std::shared_ptr< uint8_t > fftquantize( const float *pixels, size_t size ) {
+  return tinyfm3::host::quantize( pixels, size );
+}
+tinyfm3::pixel_store fftclone( const tinyfm3::pixel_store &store ) {
+  return tinyfm3::host::clone( store );
+}
+std::shared_ptr< uint8_t > fftclone_levels( const uint8_t *levels, size_t size ) {
+  return tinyfm3::host::clone_levels( levels, size );
+}
+std::pair< float, std::vector< float > > fftcomp( const tinyfm3::pixel_store &ref, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  return tinyfm3::host::compare< builtin_transform >( ref, window, frames, data, width );
+}
+tinyfm3::pixel_store fftstore( const float *pixels, size_t batch_count, size_t width, tinyfm3::pixel_precision precision ) {
+  return tinyfm3::host::store( pixels, batch_count, width, precision );
+}
+std::pair< float, std::vector< float > > fftcomp_quantized( const uint8_t *ref, size_t batch_count, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  return tinyfm3::host::compare_quantized< builtin_transform >( ref, batch_count, window, frames, data, width );
+}
+std::vector< float > fftfetch( const float *pixels, size_t size ) {
+  return tinyfm3::host::fetch( pixels, size );
+}
+std::vector< float > fftproject( const float *pixels, size_t batch_count, const tinyfm3::filterbank &bank ) {
+  return tinyfm3::host::project( pixels, batch_count, bank );
+}
+std::pair< float, std::vector< float > > fftcomp_banded( const float *ref, size_t batch_count, const tinyfm3::filterbank &bank, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  return tinyfm3::host::compare_banded< builtin_transform >( ref, batch_count, bank, window, frames, data, width );
+}
+std::pair< float, std::vector< float > > fftcomp_banded_quantized( const uint8_t *ref, size_t batch_count, const tinyfm3::filterbank &bank, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  return tinyfm3::host::compare_banded_quantized< builtin_transform >( ref, batch_count, bank, window, frames, data, width );
+}
@@ -4,10 +4,13 @@
 #include <iostream>
 #include <cufft.h>
 #include <cufftXt.h>
+#include <cuda_fp16.h>
+#include <cuda_bf16.h>
 
 #include "fft.hpp"
+#include "log_level.hpp"
 
-void init_fft() {
+void init_fft( unsigned int ) {
 }
 
 #define checkCudaErrors( expr, exception ) \
@@ -34,7 +37,10 @@ struct fft_detail {
   float a;
   float b;
   size_t width;
-  const float *reference;
+  const void *reference;
+  size_t stride;
+  int precision;
+  const uint8_t *levels;
   size_t reference_batch_count;
   float diff;
   float *envelope;
@@ -90,6 +96,16 @@ __device__ void output_log_cb(
   }
 }
 
+__device__ inline float get_reference( const fft_detail *detail, size_t index, size_t batch ) {
+  const size_t offset = index + detail->stride * batch;
+  if( detail->precision == int( tinyfm3::pixel_precision::float16 ) )
+    return __half2float( ( (const __half*)detail->reference )[ offset ] );
+  else if( detail->precision == int( tinyfm3::pixel_precision::bfloat16 ) )
+    return __bfloat162float( ( (const __nv_bfloat16*)detail->reference )[ offset ] );
+  else
+    return ( (const float*)detail->reference )[ offset ];
+}
+
 __device__ void output_comp_cb(
   void *dataOut, 
   size_t offset, 
@@ -106,7 +122,7 @@ __device__ void output_comp_cb(
       atomicAdd( detail->envelope + batch, value );
       //const float log_value_ = 80.f * __log10f( value < 1.f ? 1.f : value );
       //const int log_value = log_value_ > 255.f ? int( 255 ) : int( log_value_ );
-      atomicAdd( &detail->diff, fabsf( value - detail->reference[ index + detail->width * batch ] ) );
+      atomicAdd( &detail->diff, fabsf( value - get_reference( detail, index, batch ) ) );
     }
     else {
       const float value = cuCabsf( element );
@@ -118,11 +134,37 @@ __device__ void output_comp_cb(
   }
 }
 
+__device__ inline uint8_t get_level( float value ) {
+  const float level = 80.f * log10f( value < 1.f ? 1.f : value );
+  return uint8_t( level > 255.f ? 255.f : level );
+}
+
+__device__ void output_comp_quantized_cb(
+  void *dataOut, 
+  size_t offset, 
+  cufftComplex element, 
+  void *callerInfo, 
+  void *sharedPtr
+) {
+  fft_detail *detail = (fft_detail*)callerInfo;
+  const size_t index = offset % ( (detail->resolution/2) + 1 );
+  const size_t batch = detail->batch_offset + offset / ( (detail->resolution/2) + 1 );
+  if( index < detail->width ) {
+    const float value = cuCabsf( element );
+    atomicAdd( detail->envelope + batch, value );
+    const int level = get_level( value );
+    if( batch < detail->reference_batch_count )
+      atomicAdd( &detail->diff, float( abs( level - int( detail->levels[ index + detail->width * batch ] ) ) ) );
+    else
+      atomicAdd( &detail->diff, float( level ) );
+  }
+}
 
 __device__ cufftCallbackLoadR input_cb_ptr_d = input_cb; 
 __device__ cufftCallbackStoreC output_cb_ptr_d = output_cb;
 __device__ cufftCallbackStoreC output_log_cb_ptr_d = output_log_cb;
 __device__ cufftCallbackStoreC output_comp_cb_ptr_d = output_comp_cb;
+__device__ cufftCallbackStoreC output_comp_quantized_cb_ptr_d = output_comp_quantized_cb;
 
 __global__ void generate_window( fft_detail *detail ) {
   size_t index = threadIdx.x + blockIdx.x * 1024;
@@ -136,7 +178,28 @@ __global__ void generate_window( float *window, unsigned int resolution ) {
 
 __global__ void add_lacking_batches( fft_detail *detail, size_t offset ) {
   size_t index = threadIdx.x + blockIdx.x * 1024u + offset;
-  atomicAdd( &detail->diff, float( detail->reference[ index ] ) );
+  atomicAdd( &detail->diff, get_reference( detail, index % detail->width, index / detail->width ) );
+}
+
+__global__ void store_pixels( const float *pixels, void *dest, size_t width, size_t stride, int precision, size_t offset ) {
+  size_t index = threadIdx.x + blockIdx.x * 1024u + offset;
+  const size_t position = index % width + stride * ( index / width );
+  if( precision == int( tinyfm3::pixel_precision::float16 ) )
+    ( (__half*)dest )[ position ] = __float2half_rn( pixels[ index ] );
+  else if( precision == int( tinyfm3::pixel_precision::bfloat16 ) )
+    ( (__nv_bfloat16*)dest )[ position ] = __float2bfloat16_rn( pixels[ index ] );
+  else
+    ( (float*)dest )[ position ] = pixels[ index ];
+}
+
+__global__ void add_lacking_levels( fft_detail *detail, size_t offset ) {
+  size_t index = threadIdx.x + blockIdx.x * 1024u + offset;
+  atomicAdd( &detail->diff, float( detail->levels[ index ] ) );
+}
+
+__global__ void quantize_levels( const float *pixels, uint8_t *levels, size_t offset ) {
+  size_t index = threadIdx.x + blockIdx.x * 1024u + offset;
+  levels[ index ] = get_level( pixels[ index ] );
 }
 
 using window_list_t = boost::container::flat_map< unsigned int, std::shared_ptr< float > >;
@@ -155,12 +218,13 @@ window_list_t generate_window() {
   return std::move( result );
 }
 
-std::pair< std::vector< float >, std::shared_ptr< float > > fftref( const window_list_t &window, const std::vector< int16_t > &data, size_t resolution, float a, float b, size_t width ) {
+std::pair< std::vector< float >, std::shared_ptr< float > > fftref( const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  const size_t resolution = frames.get_resolution();
+  const float a = frames.get_a();
+  const float b = frames.get_b();
   const auto window_iter = window.find( resolution );
   if( window_iter == window.end() ) throw fft_initialization_failed( "invalid resolution" );
-  const float c = data.size() - resolution;
-  const float x = ( -b + sqrtf( b*b + 4.f * a * c ) ) / ( 2.f * a );
-  const size_t batch = size_t( x ) == 0u ? 1u : size_t( x );
+  const size_t batch = frames.get_batch_count( data.size() );
   float *envelope_d;
   checkCudaErrors(cudaMalloc( &envelope_d, sizeof(float)*batch), fft_allocation_failed );
   std::shared_ptr< float > wrapped_envelope( envelope_d, &cudaFree );
@@ -191,7 +255,7 @@ std::pair< std::vector< float >, std::shared_ptr< float > > fftref( const window
   cufftCallbackStoreC output_cb_ptr_h;
   checkCudaErrors( cudaMemcpyFromSymbol( &output_cb_ptr_h, output_log_cb_ptr_d, sizeof( cufftCallbackStoreC ) ), fft_data_transfar_failed );
   for( size_t batch_offset = 0u; batch_offset < batch; batch_offset += 4200u ) {
-    std::cout << a << " " << b << " " << x << " " << batch << " " << batch_offset << " " << std::min( batch - batch_offset, size_t( 4200u ) ) << std::endl;
+    std::cout << a << " " << b << " " << batch << " " << batch_offset << " " << std::min( batch - batch_offset, size_t( 4200u ) ) << std::endl;
     detail->batch_offset = batch_offset;
     cufftHandle plan;
     checkCuFFTErrors( cufftCreate( &plan ), fft_initialization_failed );
@@ -209,12 +273,13 @@ std::pair< std::vector< float >, std::shared_ptr< float > > fftref( const window
   return std::make_pair( std::move( envelope_h ), std::move( wrapped_output ) );
 }
 
-std::pair< float, std::vector< float > > fftcomp( const float *ref, size_t reference_batch_count, const window_list_t &window, const std::vector< int16_t > &data, size_t resolution, float a, float b, size_t width ) {
+static std::pair< float, std::vector< float > > compare( const tinyfm3::pixel_store *ref, const uint8_t *levels, size_t reference_batch_count, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  const size_t resolution = frames.get_resolution();
+  const float a = frames.get_a();
+  const float b = frames.get_b();
   const auto window_iter = window.find( resolution );
   if( window_iter == window.end() ) throw fft_initialization_failed( "invalid resolution" );
-  const float c = ( data.size() < resolution ) ? 0.f : float( data.size() - resolution );
-  const float x = ( -b + sqrtf( b*b + 4.f * a * c ) ) / ( 2.f * a );
-  const size_t batch = size_t( x ) == 0u ? 1u : size_t( x );
+  const size_t batch = frames.get_batch_count( data.size() );
   //const size_t batch = data.size() > resolution ? ( data.size() - resolution )/interval + 1 : 1u;
   float *envelope_d;
   checkCudaErrors(cudaMalloc( &envelope_d, sizeof(float)*batch), fft_allocation_failed );
@@ -229,7 +294,10 @@ std::pair< float, std::vector< float > > fftcomp( const float *ref, size_t refer
   detail->width = width;
   detail->window = window_iter->second.get();
   detail->envelope = envelope_d;
-  detail->reference = ref;
+  detail->reference = ref ? ref->get_data() : nullptr;
+  detail->stride = ref ? ref->get_stride() : width;
+  detail->precision = ref ? int( ref->get_precision() ) : 0;
+  detail->levels = levels;
   detail->reference_batch_count = reference_batch_count;
   detail->diff = 0.0f;
   detail->batch_offset = 0u;
@@ -246,7 +314,12 @@ std::pair< float, std::vector< float > > fftcomp( const float *ref, size_t refer
   cufftCallbackLoadR input_cb_ptr_h;
   checkCudaErrors( cudaMemcpyFromSymbol( &input_cb_ptr_h, input_cb_ptr_d, sizeof( cufftCallbackLoadR ) ), fft_data_transfar_failed );
   cufftCallbackStoreC output_cb_ptr_h;
-  checkCudaErrors( cudaMemcpyFromSymbol( &output_cb_ptr_h, output_comp_cb_ptr_d, sizeof( cufftCallbackStoreC ) ), fft_data_transfar_failed );
+  if( levels ) {
+    checkCudaErrors( cudaMemcpyFromSymbol( &output_cb_ptr_h, output_comp_quantized_cb_ptr_d, sizeof( cufftCallbackStoreC ) ), fft_data_transfar_failed );
+  }
+  else {
+    checkCudaErrors( cudaMemcpyFromSymbol( &output_cb_ptr_h, output_comp_cb_ptr_d, sizeof( cufftCallbackStoreC ) ), fft_data_transfar_failed );
+  }
   for( size_t batch_offset = 0u; batch_offset < batch; batch_offset += 4200u ) {
     detail->batch_offset = batch_offset;
     cufftHandle plan;
@@ -264,10 +337,18 @@ std::pair< float, std::vector< float > > fftcomp( const float *ref, size_t refer
     size_t left_count = ( reference_batch_count - batch ) * width;
     size_t left_block = left_count / 1024u;
     size_t left_mod = left_count % 1024u;
-    if( left_block )
-      add_lacking_batches<<< left_block, 1024u >>>( detail, size_t( batch * width ) );
-    if( left_mod )
-      add_lacking_batches<<< 1u, left_mod >>>( detail, size_t( batch * width + left_block * 1024u ) );
+    if( levels ) {
+      if( left_block )
+        add_lacking_levels<<< left_block, 1024u >>>( detail, size_t( batch * width ) );
+      if( left_mod )
+        add_lacking_levels<<< 1u, left_mod >>>( detail, size_t( batch * width + left_block * 1024u ) );
+    }
+    else {
+      if( left_block )
+        add_lacking_batches<<< left_block, 1024u >>>( detail, size_t( batch * width ) );
+      if( left_mod )
+        add_lacking_batches<<< 1u, left_mod >>>( detail, size_t( batch * width + left_block * 1024u ) );
+    }
   }
   checkCudaErrors( cudaDeviceSynchronize(), fft_execution_failed );
   std::vector< float > envelope_h( batch );
@@ -277,3 +358,102 @@ std::pair< float, std::vector< float > > fftcomp( const float *ref, size_t refer
 
 }
 
+std::pair< float, std::vector< float > > fftcomp( const tinyfm3::pixel_store &ref, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  return compare( &ref, nullptr, ref.get_height(), window, frames, data, width );
+}
+
+std::pair< float, std::vector< float > > fftcomp_quantized( const uint8_t *ref, size_t reference_batch_count, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  return compare( nullptr, ref, reference_batch_count, window, frames, data, width );
+}
+
+tinyfm3::pixel_store fftstore( const float *pixels, size_t batch_count, size_t width, tinyfm3::pixel_precision precision ) {
+  const size_t stride = tinyfm3::pixel_store::get_stride( width, precision );
+  const size_t size = stride * batch_count * tinyfm3::pixel_store::get_element_size( precision );
+  void *dest;
+  checkCudaErrors( cudaMalloc( &dest, size ), fft_allocation_failed );
+  std::shared_ptr< void > wrapped( dest, &cudaFree );
+  checkCudaErrors( cudaMemset( dest, 0, size ), fft_initialization_failed );
+  const size_t count = batch_count * width;
+  const size_t block = count / 1024u;
+  const size_t mod = count % 1024u;
+  if( block )
+    store_pixels<<< block, 1024u >>>( pixels, dest, width, stride, int( precision ), size_t( 0u ) );
+  if( mod )
+    store_pixels<<< 1u, mod >>>( pixels, dest, width, stride, int( precision ), size_t( block * 1024u ) );
+  checkCudaErrors( cudaDeviceSynchronize(), fft_execution_failed );
+  return tinyfm3::pixel_store( wrapped, width, batch_count, precision );
+}
+
+std::shared_ptr< uint8_t > fftquantize( const float *pixels, size_t size ) {
+  uint8_t *levels;
+  checkCudaErrors( cudaMalloc( &levels, size ), fft_allocation_failed );
+  std::shared_ptr< uint8_t > wrapped( levels, &cudaFree );
+  const size_t block = size / 1024u;
+  const size_t mod = size % 1024u;
+  if( block )
+    quantize_levels<<< block, 1024u >>>( pixels, levels, size_t( 0u ) );
+  if( mod )
+    quantize_levels<<< 1u, mod >>>( pixels, levels, size_t( block * 1024u ) );
+  checkCudaErrors( cudaDeviceSynchronize(), fft_execution_failed );
+  return wrapped;
+}
+
+tinyfm3::pixel_store fftclone( const tinyfm3::pixel_store &store ) {
+  if( store.empty() ) return tinyfm3::pixel_store();
+  const size_t size = store.get_stride() * store.get_height() * tinyfm3::pixel_store::get_element_size( store.get_precision() );
+  void *dest;
+  checkCudaErrors( cudaMalloc( &dest, size ), fft_allocation_failed );
+  std::shared_ptr< void > wrapped( dest, &cudaFree );
+  checkCudaErrors( cudaMemcpy( dest, store.get_data(), size, cudaMemcpyDeviceToDevice ), fft_data_transfar_failed );
+  return tinyfm3::pixel_store( wrapped, store.get_width(), store.get_height(), store.get_precision() );
+}
+
+std::shared_ptr< uint8_t > fftclone_levels( const uint8_t *source, size_t size ) {
+  uint8_t *levels;
+  checkCudaErrors( cudaMalloc( &levels, size ), fft_allocation_failed );
+  std::shared_ptr< uint8_t > wrapped( levels, &cudaFree );
+  checkCudaErrors( cudaMemcpy( levels, source, size, cudaMemcpyDeviceToDevice ), fft_data_transfar_failed );
+  return wrapped;
+}
+
+std::vector< float > fftfetch( const float *pixels, size_t size ) {
+  std::vector< float > host( size );
+  checkCudaErrors( cudaMemcpy( host.data(), pixels, sizeof(float)*host.size(), cudaMemcpyDeviceToHost ), fft_data_transfar_failed );
+  return host;
+}
+
+std::vector< float > fftproject( const float *pixels, size_t batch_count, const tinyfm3::filterbank &bank ) {
+  const auto host = fftfetch( pixels, batch_count * bank.get_width() );
+  std::vector< float > bands( batch_count * bank.get_band_count() );
+  bank( host.data(), bands.data(), batch_count );
+  return bands;
+}
+
+static std::pair< float, std::vector< float > > compare_bands( const float *ref, const uint8_t *levels, size_t reference_batch_count, const tinyfm3::filterbank &bank, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  auto converted = fftref( window, frames, data, width );
+  const size_t batch = converted.first.size();
+  const size_t band_count = bank.get_band_count();
+  const auto bands = fftproject( converted.second.get(), batch, bank );
+  const auto &quantize = tinyfm3::log_level::get();
+  double diff = 0.0;
+  for( size_t i = 0u; i != std::max( batch, reference_batch_count ) * band_count; ++i ) {
+    const bool has_ref = i < reference_batch_count * band_count;
+    const bool has_candidate = i < batch * band_count;
+    if( levels ) {
+      const int l = has_candidate ? quantize( bands[ i ] ) : 0;
+      const int r = has_ref ? levels[ i ] : 0;
+      diff += std::abs( l - r );
+    }
+    else
+      diff += std::abs( ( has_candidate ? bands[ i ] : 0.f ) - ( has_ref ? ref[ i ] : 0.f ) );
+  }
+  return std::make_pair( float( diff ), std::move( converted.first ) );
+}
+
+std::pair< float, std::vector< float > > fftcomp_banded( const float *ref, size_t reference_batch_count, const tinyfm3::filterbank &bank, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  return compare_bands( ref, nullptr, reference_batch_count, bank, window, frames, data, width );
+}
+
+std::pair< float, std::vector< float > > fftcomp_banded_quantized( const uint8_t *ref, size_t reference_batch_count, const tinyfm3::filterbank &bank, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  return compare_bands( nullptr, ref, reference_batch_count, bank, window, frames, data, width );
+}
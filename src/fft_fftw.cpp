@@ -1,108 +1,86 @@
 #include <cmath>
 #include <vector>
 #include <complex>
-#include <algorithm>
+#include <mutex>
 #include <fftw3.h>
 
 #include "fft.hpp"
+#include "fft_host.hpp"
 
-void init_fft() {
+class fftw_transform {
+public:
+  fftw_transform( size_t resolution ) :
+    input( fftwf_alloc_real( resolution ), &fftwf_free ),
+    output( fftwf_alloc_complex( resolution / 2u + 1u ), &fftwf_free ) {
+    if( !input ) throw fft_allocation_failed( "unable to allocate memory for input" );
+    if( !output ) throw fft_allocation_failed( "unable to allocate memory for output" );
+    {
+      std::lock_guard< std::mutex > lock( get_planner_mutex() );
+      plan = fftwf_plan_dft_r2c_1d( resolution, input.get(), output.get(), FFTW_ESTIMATE );
+    }
+    if( !plan ) throw fft_initialization_failed( "unable to create the plan" );
+  }
+  fftw_transform( const fftw_transform& ) = delete;
+  fftw_transform &operator=( const fftw_transform& ) = delete;
+  ~fftw_transform() {
+    std::lock_guard< std::mutex > lock( get_planner_mutex() );
+    fftwf_destroy_plan( plan );
+  }
+  float *get_input() { return input.get(); }
+  void operator()( float *magnitudes, size_t width ) {
+    fftwf_execute( plan );
+    for( size_t i = 0u; i != width; ++i )
+      magnitudes[ i ] = std::abs( std::complex< float >( output.get()[ i ][ 0 ], output.get()[ i ][ 1 ] ) );
+  }
+private:
+  static std::mutex &get_planner_mutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+  std::unique_ptr< float, void(*)( void* ) > input;
+  std::unique_ptr< fftwf_complex, void(*)( void* ) > output;
+  fftwf_plan plan;
+};
+
+void init_fft( unsigned int thread_count ) {
   fftwf_init_threads();
-  fftwf_plan_with_nthreads( 4 );
+  fftwf_plan_with_nthreads( thread_count );
 }
 
 window_list_t generate_window() {
-  window_list_t result;
-  for( unsigned int i = 16u; i != 65536u; i <<= 1 ) {
-    float *window;
-    std::shared_ptr< float > w( new float[ i ], []( float *p ) { delete[] p; } );
-    for( unsigned int j = 0u; j != i; ++j )
-      w.get()[ j ] = sinf( float( M_PI ) * float( j ) / i );
-    result.insert( result.end(), std::make_pair( i, std::move( w ) ) );
-  }
-  return std::move( result );
+  return tinyfm3::host::generate_window();
 }
 
-std::pair< std::vector< float >, std::shared_ptr< float > > fftref( const window_list_t &window, const std::vector< int16_t > &data, size_t resolution, float a, float b, size_t width ) {
-  const auto window_iter = window.find( resolution );
-  if( window_iter == window.end() ) throw fft_initialization_failed( "invalid resolution" );
-  const float c = data.size() - resolution;
-  const float x = ( -b + sqrtf( b*b + 4.f * a * c ) ) / ( 2.f * a );
-  const size_t batch = size_t( x ) == 0u ? 1u : size_t( x );
-  std::shared_ptr< float > input( (float*)fftwf_malloc( sizeof(float) * resolution ), &fftwf_free );
-  if( !input ) throw fft_allocation_failed( "unable to allocate memory for input" );
-  std::shared_ptr< fftwf_complex > output( (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*resolution), &fftwf_free );
-  if( !output ) throw fft_allocation_failed( "unable to allocate memory for output" );
-  fftwf_plan plan = fftwf_plan_dft_r2c_1d( resolution, input.get(), output.get(), FFTW_ESTIMATE );
-  if( !plan ) fft_initialization_failed( "unable to create the plan" );
-  std::vector< float > envelope;
-  std::shared_ptr< float > pixels( new float[ batch * width ], []( float *p ) { delete[] p; } );
-  for( size_t current_batch = 0u; current_batch != batch; ++current_batch ) {
-    for( size_t i = 0u; i != resolution; ++i )
-      input.get()[ i ] = data[ i + size_t( current_batch * current_batch * a + current_batch * b ) ]/32767.f * window_iter->second.get()[ i ];
-    fftwf_execute( plan );
-    float sum = 0.f;
-    for( size_t i = 0u; i != width; ++i ) {
-      const float value = std::abs( std::complex< float >( output.get()[ i ][ 0 ], output.get()[ i ][ 1 ] ) );
-      //const uint8_t log_value = uint8_t( std::min( std::max( 80.f * std::log10( std::max( value, 1.f ) ), 0.f ), 255.f ) );
-      pixels.get()[ i + current_batch * width ] = value;
-      sum += value;
-    }
-    envelope.push_back( sum );
-  }
-  fftwf_destroy_plan( plan );
-  return std::make_pair( std::move( envelope ), pixels );
+std::pair< std::vector< float >, std::shared_ptr< float > > fftref( const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  return tinyfm3::host::reference< fftw_transform >( window, frames, data, width );
 }
-std::pair< float, std::vector< float > > fftcomp( const float *ref, size_t batch_count, const window_list_t &window, const std::vector< int16_t > &data, size_t resolution, float a, float b, size_t width ) {
-  const auto window_iter = window.find( resolution );
-  if( window_iter == window.end() ) throw fft_initialization_failed( "invalid resolution" );
-  const float c = data.size() - resolution;
-  const float x = ( -b + sqrtf( b*b + 4.f * a * c ) ) / ( 2.f * a );
-  const size_t batch = size_t( x ) == 0u ? 1u : size_t( x );
-  std::shared_ptr< float > input( (float*)fftwf_malloc( sizeof(float) * resolution ), &fftwf_free );
-  if( !input ) throw fft_allocation_failed( "unable to allocate memory for input" );
-  std::shared_ptr< fftwf_complex > output( (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*resolution), &fftwf_free );
-  if( !output ) throw fft_allocation_failed( "unable to allocate memory for output" );
-  fftwf_plan plan = fftwf_plan_dft_r2c_1d( resolution, input.get(), output.get(), FFTW_ESTIMATE );
-  if( !plan ) fft_initialization_failed( "unable to create the plan" );
-  std::vector< float > envelope;
-  float diff = 0.f;
-  size_t current_batch = 0u;
-  size_t min_batch_count = std::min( batch_count, batch );
-  for( ; current_batch != min_batch_count; ++current_batch ) {
-    for( size_t i = 0u; i != resolution; ++i )
-      input.get()[ i ] = data[ i + size_t( current_batch * current_batch * a + current_batch * b ) ]/32767.f * window_iter->second.get()[ i ];
-    fftwf_execute( plan );
-    float sum = 0.f;
-    for( size_t i = 0u; i != width; ++i ) {
-      const float value = std::abs( std::complex< float >( output.get()[ i ][ 0 ], output.get()[ i ][ 1 ] ) );
-      //const uint8_t log_value = uint8_t( std::min( std::max( 80.f * std::log10( std::max( value, 1.f ) ), 0.f ), 255.f ) );
-      diff += std::abs( value - ref[ i + current_batch * width ] );
-      sum += value;
-    }
-    envelope.push_back( sum );
-  }
-  if( batch_count > batch ) {
-    for( ; current_batch != batch_count; ++current_batch )
-      for( size_t i = 0u; i != width; ++i )
-        diff += ref[ i + current_batch * width ];
-  }
-  else if( batch_count < batch ) {
-    for( ; current_batch != batch; ++current_batch ) {
-      for( size_t i = 0u; i != resolution; ++i )
-        input.get()[ i ] = data[ i + size_t( current_batch * current_batch * a + current_batch * b ) ]/32767.f * window_iter->second.get()[ i ];
-      fftwf_execute( plan );
-      float sum = 0.f;
-      for( size_t i = 0u; i != width; ++i ) {
-        const float value = std::abs( std::complex< float >( output.get()[ i ][ 0 ], output.get()[ i ][ 1 ] ) );
-        //const uint8_t log_value = uint8_t( std::min( std::max( 80.f * std::log10( std::max( value, 1.f ) ), 0.f ), 255.f ) );
-        diff += value;//log_value;
-        sum += value;
-      }
-      envelope.push_back( sum );
-    }
-  }
-  fftwf_destroy_plan( plan );
-  return std::make_pair( diff, std::move( envelope ) );
+std::shared_ptr< uint8_t > fftquantize( const float *pixels, size_t size ) {
+  return tinyfm3::host::quantize( pixels, size );
+}
+tinyfm3::pixel_store fftclone( const tinyfm3::pixel_store &store ) {
+  return tinyfm3::host::clone( store );
+}
+std::shared_ptr< uint8_t > fftclone_levels( const uint8_t *levels, size_t size ) {
+  return tinyfm3::host::clone_levels( levels, size );
+}
+std::pair< float, std::vector< float > > fftcomp( const tinyfm3::pixel_store &ref, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  return tinyfm3::host::compare< fftw_transform >( ref, window, frames, data, width );
+}
+tinyfm3::pixel_store fftstore( const float *pixels, size_t batch_count, size_t width, tinyfm3::pixel_precision precision ) {
+  return tinyfm3::host::store( pixels, batch_count, width, precision );
+}
+std::pair< float, std::vector< float > > fftcomp_quantized( const uint8_t *ref, size_t batch_count, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  return tinyfm3::host::compare_quantized< fftw_transform >( ref, batch_count, window, frames, data, width );
+}
+std::vector< float > fftfetch( const float *pixels, size_t size ) {
+  return tinyfm3::host::fetch( pixels, size );
+}
+std::vector< float > fftproject( const float *pixels, size_t batch_count, const tinyfm3::filterbank &bank ) {
+  return tinyfm3::host::project( pixels, batch_count, bank );
+}
+std::pair< float, std::vector< float > > fftcomp_banded( const float *ref, size_t batch_count, const tinyfm3::filterbank &bank, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  return tinyfm3::host::compare_banded< fftw_transform >( ref, batch_count, bank, window, frames, data, width );
+}
+std::pair< float, std::vector< float > > fftcomp_banded_quantized( const uint8_t *ref, size_t batch_count, const tinyfm3::filterbank &bank, const window_list_t &window, const tinyfm3::frame_table &frames, const std::vector< int16_t > &data, size_t width ) {
+  return tinyfm3::host::compare_banded_quantized< fftw_transform >( ref, batch_count, bank, window, frames, data, width );
 }
-
@@ -6,9 +6,12 @@
 #include <complex>
 #include <tuple>
 #include <algorithm>
+#include <numeric>
+#include <random>
 #include <chrono>
 #include <boost/program_options.hpp>
 #include <boost/spirit/include/karma.hpp>
+#include <boost/spirit/include/qi.hpp>
 #include <boost/container/flat_map.hpp>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -23,9 +26,13 @@
 #include "load_monoral.hpp"
 #include "generate_tone.hpp"
 #include "dna.hpp"
+#include "population.hpp"
+#include "preset_index.hpp"
+#include "surrogate_model.hpp"
 #include "get_image_distance.hpp"
 #include "spectrum_image.hpp"
 #include "fft.hpp"
+#include "numa_topology.hpp"
 
 struct by_sum;
 struct by_score;
@@ -57,6 +64,306 @@ struct output_float_policy : boost::spirit::karma::real_policies< T >
   static unsigned precision(T) { return 20u; }
 };
 
+struct generation_stats {
+  generation_stats() : evaluations( 0u ), samples( 0u ), frames( 0u ), skipped( 0u ), predicted( 0u ), prediction_error( 0.0 ) {}
+  generation_stats &operator+=( const generation_stats &r ) {
+    evaluations += r.evaluations;
+    samples += r.samples;
+    frames += r.frames;
+    skipped += r.skipped;
+    predicted += r.predicted;
+    prediction_error += r.prediction_error;
+    return *this;
+  }
+  double get_skipped_ratio() const {
+    return ( evaluations + skipped ) ? double( skipped ) / double( evaluations + skipped ) : 0.0;
+  }
+  double get_prediction_error() const {
+    return predicted ? prediction_error / predicted : 0.0;
+  }
+  size_t evaluations;
+  size_t samples;
+  size_t frames;
+  size_t skipped;
+  size_t predicted;
+  double prediction_error;
+};
+
+struct fitting_target {
+  fitting_target( int note_, float velocity_, float weight_ ) : note( note_ ), velocity( velocity_ ), weight( weight_ ) {}
+  int note;
+  float velocity;
+  float weight;
+  std::vector< spectrum_image > references;
+  std::vector< std::vector< spectrum_image > > replicas;
+  std::vector< const spectrum_image* > node_references;
+};
+
+bool parse_target( const std::string &serialized, std::string &filename, int &note, float &velocity, float &weight ) {
+  std::vector< std::string > fields;
+  size_t pos = 0u;
+  while( true ) {
+    const size_t next = serialized.find( ':', pos );
+    fields.push_back( serialized.substr( pos, next == std::string::npos ? std::string::npos : next - pos ) );
+    if( next == std::string::npos ) break;
+    pos = next + 1u;
+  }
+  if( fields.size() < 2u || fields.size() > 4u || fields[ 0 ].empty() ) return false;
+  try {
+    filename = fields[ 0 ];
+    note = std::stoi( fields[ 1 ] );
+    velocity = fields.size() > 2u ? std::stof( fields[ 2 ] ) : 1.f;
+    weight = fields.size() > 3u ? std::stof( fields[ 3 ] ) : 1.f;
+  } catch( const std::exception& ) {
+    return false;
+  }
+  return weight > 0.f;
+}
+
+std::vector< spectrum_image > create_references(
+  const window_list_t &window,
+  const std::vector< int16_t > &audio,
+  int weight,
+  unsigned int interval,
+  bool quantized,
+  size_t band_count,
+  tinyfm3::band_scale band,
+  tinyfm3::pixel_precision precision
+) {
+  std::vector< spectrum_image > references;
+  references.reserve( 15u );
+  references.emplace_back( window, audio, 32, 44100, 128, 15, weight, interval, quantized, band_count, band, precision );
+  references.emplace_back( window, audio, 64, 44100, 256, 14, weight, interval, quantized, band_count, band, precision );
+  references.emplace_back( window, audio, 64, 44100, 256, 13, weight, interval, quantized, band_count, band, precision );
+  references.emplace_back( window, audio, 128, 44100, 512, 12, weight, interval, quantized, band_count, band, precision );
+  references.emplace_back( window, audio, 128, 44100, 512, 11, weight, interval, quantized, band_count, band, precision );
+  references.emplace_back( window, audio, 256, 44100, 1024, 10, weight, interval, quantized, band_count, band, precision );
+  references.emplace_back( window, audio, 256, 44100, 1024, 9, weight, interval, quantized, band_count, band, precision );
+  references.emplace_back( window, audio, 512, 44100, 2048, 8, weight, interval, quantized, band_count, band, precision );
+  references.emplace_back( window, audio, 512, 44100, 2048,  7, weight, interval, quantized, band_count, band, precision );
+  references.emplace_back( window, audio, 1024, 44100, 4096, 6, weight, interval, quantized, band_count, band, precision );
+  references.emplace_back( window, audio, 1024, 44100, 4096, 5, weight, interval, quantized, band_count, band, precision );
+  references.emplace_back( window, audio, 2048, 44100, 8192, 4, weight, interval, quantized, band_count, band, precision );
+  references.emplace_back( window, audio, 2048, 44100, 8192, 3, weight, interval, quantized, band_count, band, precision );
+  references.emplace_back( window, audio, 4096, 44100, 8192, 2, weight, interval, quantized, band_count, band, precision );
+  references.emplace_back( window, audio, 4096, 44100, 8192, 1, weight, interval, quantized, band_count, band, precision );
+  return references;
+}
+
+generation_stats evaluate(
+  population &dnas,
+  const tinyfm3::pinned_workers &workers,
+  const std::vector< fitting_target > &targets,
+  size_t mipmap_level,
+  const window_list_t &window,
+  float release_time,
+  bool has_release,
+  surrogate_model *surrogate,
+  float screening_ratio,
+  size_t min_evaluations,
+  std::mt19937 &random_generator
+) {
+  const float *configs = dnas.decode( release_time, has_release );
+  double *scores = dnas.get_scores();
+  std::vector< size_t > pending;
+  pending.reserve( dnas.size() );
+  for( size_t i = 0u; i != dnas.size(); ++i )
+    if( !dnas.is_cached( i ) ) pending.push_back( i );
+  std::vector< size_t > skipped;
+  std::vector< double > predicted;
+  std::vector< uint8_t > audited;
+  std::vector< float > parameters( population::gene_count );
+  if( surrogate && surrogate->size() >= dnas.size() && !pending.empty() ) {
+    std::vector< std::pair< double, size_t > > ranked;
+    ranked.reserve( pending.size() );
+    for( const auto i: pending ) {
+      dnas.get_parameters( i, parameters.data() );
+      ranked.emplace_back( surrogate->predict( parameters.data() ), i );
+    }
+    std::stable_sort( ranked.begin(), ranked.end(),
+      []( const std::pair< double, size_t > &l, const std::pair< double, size_t > &r ) { return l.first < r.first; } );
+    const size_t keep = std::min( pending.size(), std::max( min_evaluations, size_t( std::ceil( screening_ratio * pending.size() ) ) ) );
+    std::vector< size_t > order( ranked.size() );
+    std::iota( order.begin(), order.end(), size_t( 0u ) );
+    std::vector< uint8_t > sampled( ranked.size(), 0u );
+    const size_t sample_count = std::max( size_t( 1u ), ranked.size() / 16u );
+    for( size_t j = 0u; j != sample_count; ++j ) {
+      std::uniform_int_distribution< size_t > distribution( j, ranked.size() - 1u );
+      std::swap( order[ j ], order[ distribution( random_generator ) ] );
+      sampled[ order[ j ] ] = 1u;
+    }
+    pending.clear();
+    for( size_t j = 0u; j != ranked.size(); ++j ) {
+      if( j < keep || sampled[ j ] ) {
+        pending.push_back( ranked[ j ].second );
+        predicted.push_back( ranked[ j ].first );
+        audited.push_back( sampled[ j ] );
+      }
+      else skipped.push_back( ranked[ j ].second );
+    }
+  }
+  const size_t target_count = targets.size();
+  std::vector< double > distances( pending.size() * target_count );
+  std::vector< generation_stats > worker_stats( workers.get_count() );
+  workers( [&]( unsigned int t, size_t node ) {
+    generation_stats &stats = worker_stats[ t ];
+    for( size_t j = t; j < distances.size(); j += workers.get_count() ) {
+      const size_t i = pending[ j / target_count ];
+      const auto &target = targets[ j % target_count ];
+      const spectrum_image &ref = target.node_references[ node ][ mipmap_level ];
+      const spectrum_image &eref = target.references.back();
+      const auto audio = generate_tone(
+        target.note,
+        eref.get_delay_time()*tinyfm3::frequency,
+        eref.get_release_time()*tinyfm3::frequency,
+        eref.get_total_time()*tinyfm3::frequency,
+        configs + i * population::config_size,
+        configs + ( i + 1u ) * population::config_size,
+        has_release,
+        target.velocity
+      );
+      distances[ j ] = get_distance(
+        ref,
+        window,
+        audio
+      );
+      stats.samples += audio.size();
+      stats.frames += ref.get_frames().get_batch_count( audio.size() );
+    }
+  } );
+  double weight_sum = 0.0;
+  for( const auto &target: targets ) weight_sum += target.weight;
+  generation_stats stats;
+  for( size_t j = 0u; j != pending.size(); ++j ) {
+    double distance = 0.0;
+    for( size_t k = 0u; k != target_count; ++k )
+      distance += targets[ k ].weight * distances[ j * target_count + k ];
+    distance /= weight_sum;
+    scores[ pending[ j ] ] = 1.0/(distance*distance);
+    if( surrogate ) {
+      const double value = std::log( std::max( distance, 1.0e-30 ) );
+      if( !audited.empty() && audited[ j ] ) {
+        stats.prediction_error += std::fabs( predicted[ j ] - value );
+        ++stats.predicted;
+      }
+      dnas.get_parameters( pending[ j ], parameters.data() );
+      surrogate->add( parameters.data(), value );
+    }
+  }
+  for( const auto i: skipped ) scores[ i ] = 0.0;
+  for( const auto &s: worker_stats ) stats += s;
+  stats.evaluations = pending.size();
+  stats.skipped = skipped.size();
+  return stats;
+}
+
+int get_mutation_rate( size_t cycle ) {
+  return ( cycle % 20 ) ? 80+cycle/5 : 8+cycle/50;
+}
+
+double get_percentile( const std::vector< double > &sorted, double p ) {
+  if( sorted.empty() ) return 0.0;
+  const size_t rank = size_t( std::ceil( p * sorted.size() ) );
+  return sorted[ std::min( std::max( rank, size_t( 1u ) ), sorted.size() ) - 1u ];
+}
+
+struct benchmark_result {
+  size_t level;
+  size_t population;
+  generation_stats total;
+  double wall_time;
+  std::vector< double > generation_times;
+};
+
+template< size_t level_count >
+benchmark_result run_benchmark(
+  const tinyfm3::pinned_workers &workers,
+  const std::vector< fitting_target > &targets,
+  const std::array< int, level_count > &survive_count,
+  const tinyfm3::genome_schema &schema,
+  const window_list_t &window,
+  size_t mipmap_level,
+  unsigned int cycles,
+  unsigned int seed,
+  float release_time,
+  bool has_release,
+  float screening_ratio,
+  size_t neighbor_count
+) {
+  std::mt19937 random_generator( seed );
+  population dnas( survive_count[ 0 ] * survive_count[ 0 ], schema );
+  dnas.generate( survive_count[ 0 ] * survive_count[ 0 ], random_generator );
+  surrogate_model surrogate( population::gene_count, dnas.size() * 4u, neighbor_count );
+  benchmark_result result;
+  result.level = mipmap_level;
+  result.generation_times.reserve( cycles );
+  const size_t elite_count = std::min( survive_count[ mipmap_level ], int( mipmap_level / 2u + 1u ) );
+  const auto run_generation = [&]( size_t cycle ) {
+    const auto stats = evaluate( dnas, workers, targets, mipmap_level, window, release_time, has_release, screening_ratio < 1.f ? &surrogate : nullptr, screening_ratio, survive_count[ mipmap_level ], random_generator );
+    size_t top_index = 0u;
+    dnas.select( survive_count[ mipmap_level ], elite_count, random_generator, top_index );
+    dnas.breed( get_mutation_rate( cycle ), random_generator );
+    return stats;
+  };
+  run_generation( 0u );
+  result.population = dnas.size();
+  const auto begin = std::chrono::high_resolution_clock::now();
+  for( size_t cycle = 1u; cycle <= cycles; ++cycle ) {
+    const auto generation_begin = std::chrono::high_resolution_clock::now();
+    result.total += run_generation( cycle );
+    const auto generation_end = std::chrono::high_resolution_clock::now();
+    result.generation_times.push_back( std::chrono::duration_cast< std::chrono::duration< double > >( generation_end - generation_begin ).count() );
+  }
+  const auto end = std::chrono::high_resolution_clock::now();
+  result.wall_time = std::chrono::duration_cast< std::chrono::duration< double > >( end - begin ).count();
+  return result;
+}
+
+void print_benchmark( const std::vector< benchmark_result > &results, unsigned int seed, unsigned int cycles ) {
+  for( const auto &r: results ) {
+    std::vector< double > sorted( r.generation_times );
+    std::sort( sorted.begin(), sorted.end() );
+    std::cout << "level " << r.level
+      << " evaluations/s " << r.total.evaluations / r.wall_time
+      << " samples/s " << r.total.samples / r.wall_time
+      << " frames/s " << r.total.frames / r.wall_time
+      << " skipped " << r.total.get_skipped_ratio()
+      << " prediction error " << r.total.get_prediction_error()
+      << " generation p50 " << get_percentile( sorted, 0.5 )
+      << " p90 " << get_percentile( sorted, 0.9 )
+      << " p99 " << get_percentile( sorted, 0.99 ) << std::endl;
+  }
+  std::cout << "{\"seed\":" << seed << ",\"cycles\":" << cycles << ",\"levels\":[";
+  for( size_t i = 0u; i != results.size(); ++i ) {
+    const auto &r = results[ i ];
+    std::vector< double > sorted( r.generation_times );
+    std::sort( sorted.begin(), sorted.end() );
+    const double mean = std::accumulate( sorted.begin(), sorted.end(), 0.0 ) / std::max( sorted.size(), size_t( 1u ) );
+    if( i ) std::cout << ",";
+    std::cout << "{\"level\":" << r.level
+      << ",\"population\":" << r.population
+      << ",\"evaluations\":" << r.total.evaluations
+      << ",\"samples\":" << r.total.samples
+      << ",\"frames\":" << r.total.frames
+      << ",\"skipped\":" << r.total.skipped
+      << ",\"skipped_ratio\":" << r.total.get_skipped_ratio()
+      << ",\"prediction_error\":" << r.total.get_prediction_error()
+      << ",\"wall_time\":" << r.wall_time
+      << ",\"evaluations_per_sec\":" << r.total.evaluations / r.wall_time
+      << ",\"samples_per_sec\":" << r.total.samples / r.wall_time
+      << ",\"frames_per_sec\":" << r.total.frames / r.wall_time
+      << ",\"generation_time\":{"
+      << "\"mean\":" << mean
+      << ",\"min\":" << ( sorted.empty() ? 0.0 : sorted.front() )
+      << ",\"p50\":" << get_percentile( sorted, 0.5 )
+      << ",\"p90\":" << get_percentile( sorted, 0.9 )
+      << ",\"p99\":" << get_percentile( sorted, 0.99 )
+      << ",\"max\":" << ( sorted.empty() ? 0.0 : sorted.back() )
+      << "}}";
+  }
+  std::cout << "]}" << std::endl;
+}
+
 int main( int argc, char* argv[] ) {
   boost::program_options::options_description options("オプション");
   options.add_options()
@@ -64,26 +371,92 @@ int main( int argc, char* argv[] ) {
     ("input,i", boost::program_options::value<std::string>(),  "入力ファイル")
     ("output,o", boost::program_options::value<std::string>(),  "出力ディレクトリ")
     ("note,n", boost::program_options::value<int>()->default_value(60),  "音階")
+    ("velocity,v", boost::program_options::value<float>()->default_value(1.f),  "ベロシティ")
+    ("target", boost::program_options::value<std::vector<std::string>>()->composing(),  "同時に合わせる参照 (ファイル:音階[:ベロシティ[:重み]])")
     ("mipmap,m", boost::program_options::value<int>()->default_value(0),  "初期ミップマップレベル")
     ("has-release,r", boost::program_options::value<bool>()->default_value(true),  "NOTE_OFFを有する楽器か")
     ("cycle,c", boost::program_options::value<unsigned int>()->default_value(4000),  "世代数")
     ("stickiness,s", boost::program_options::value<unsigned int>()->default_value(7),  "何世代トップが変化しなかったら次の分解能に移るか")
     ("interval,t", boost::program_options::value<unsigned int>()->default_value(2),  "時間方向の間隔")
-    ("weight,w", boost::program_options::value<int>()->default_value(-5),  "時間方向の重み");
+    ("weight,w", boost::program_options::value<int>()->default_value(-5),  "時間方向の重み")
+    ("quantized,q", boost::program_options::bool_switch()->default_value(false),  "スペクトルを8bitの対数値に量子化して比較する")
+    ("bands,b", boost::program_options::value<size_t>()->default_value(0u),  "比較する帯域数 (0で全ビンを比較)")
+    ("band-scale", boost::program_options::value<std::string>()->default_value("mel"),  "帯域の尺度 (mel|erb|linear)")
+    ("precision,p", boost::program_options::value<std::string>()->default_value("float32"),  "参照スペクトルの保存形式 (float32|float16|bfloat16)")
+    ("jobs,j", boost::program_options::value<unsigned int>()->default_value(1u),  "評価に使うスレッド数")
+    ("numa", boost::program_options::bool_switch()->default_value(false),  "ワーカーをコアに固定し参照スペクトルをNUMAノード毎に複製する")
+    ("lock", boost::program_options::value<std::string>(),  "固定する遺伝子と値 (例: fm0.freq=2,fm3.func=0)")
+    ("gray", boost::program_options::bool_switch()->default_value(false),  "遺伝子をグレイコードで表現する")
+    ("warm-start", boost::program_options::value<std::string>(),  "初期集団の一部を類似した過去のプリセットから作るためのインデックス")
+    ("warm-start-count", boost::program_options::value<size_t>()->default_value(16u),  "インデックスから初期集団に加えるプリセットの数")
+    ("surrogate", boost::program_options::value<float>()->default_value(1.f),  "代理モデルで選別した後に実際に評価する子の割合 (1で代理モデルを使わない)")
+    ("surrogate-neighbors", boost::program_options::value<size_t>()->default_value(8u),  "代理モデルが参照する近傍の数")
+    ("resample-taps", boost::program_options::value<size_t>()->default_value(32u),  "44.1kHz以外の入力を変換するフィルタのタップ数")
+    ("seed", boost::program_options::value<unsigned int>(),  "乱数のシード")
+    ("bench", boost::program_options::bool_switch()->default_value(false),  "ベンチマークモード")
+    ("bench-cycle", boost::program_options::value<unsigned int>()->default_value(20),  "ベンチマークで各ミップマップレベルを計測する世代数(計測前に1世代を空回しする)")
+    ("bench-levels", boost::program_options::value<std::string>()->default_value("0,4,8,12,14"),  "ベンチマークするミップマップレベル(カンマ区切り)");
   boost::program_options::variables_map params;
   boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
   boost::program_options::notify( params );
-  if( params.count("help") || !params.count("input") || !params.count("output") || !params.count( "note" ) ) {
+  const bool bench = params["bench"].as<bool>();
+  if( params.count("help") || !params.count("input") || ( !params.count("output") && !bench ) || !params.count( "note" ) ) {
     std::cout << options << std::endl;
     return 0;
   }
   const std::string input_filename = params["input"].as<std::string>();
-  const std::string output_dir = params["output"].as<std::string>();
+  const std::string output_dir = params.count("output") ? params["output"].as<std::string>() : std::string();
   const int weight = params["weight"].as<int>();
   const unsigned int interval = params["interval"].as<unsigned int>();
-  init_fft();
+  const bool quantized = params["quantized"].as<bool>();
+  const size_t band_count = params["bands"].as<size_t>();
+  tinyfm3::band_scale band;
+  if( !tinyfm3::parse_band_scale( params["band-scale"].as<std::string>(), band ) ) {
+    std::cerr << "Invalid band scale" << std::endl;
+    return -1;
+  }
+  tinyfm3::pixel_precision precision;
+  if( !tinyfm3::parse_pixel_precision( params["precision"].as<std::string>(), precision ) ) {
+    std::cerr << "Invalid precision" << std::endl;
+    return -1;
+  }
+  tinyfm3::genome_schema schema;
+  if( params["gray"].as<bool>() ) schema.set_encoding( tinyfm3::gene_encoding::gray );
+  if( params.count("lock") && !schema.lock( params["lock"].as<std::string>() ) ) {
+    std::cerr << "Invalid gene lock" << std::endl;
+    return -1;
+  }
+  const float screening_ratio = params["surrogate"].as<float>();
+  const size_t neighbor_count = params["surrogate-neighbors"].as<size_t>();
+  if( !( screening_ratio > 0.f && screening_ratio <= 1.f ) || neighbor_count == 0u ) {
+    std::cerr << "Invalid surrogate" << std::endl;
+    return -1;
+  }
+  preset_index warm_start;
+  if( params.count("warm-start") && !warm_start.load( params["warm-start"].as<std::string>() ) ) {
+    std::cerr << "Unable to load " << params["warm-start"].as<std::string>() << std::endl;
+    return -1;
+  }
+  init_fft( params["jobs"].as<unsigned int>() > 1u ? 1u : 4u );
   const auto window = generate_window();
-  const auto audio = load_monoral( input_filename );
+  const size_t resample_taps = params["resample-taps"].as<size_t>();
+  std::vector< fitting_target > targets;
+  targets.emplace_back( params["note"].as<int>(), params["velocity"].as<float>(), 1.f );
+  if( params.count("target") ) {
+    for( const auto &serialized: params["target"].as<std::vector<std::string>>() ) {
+      std::string filename;
+      int note = 0;
+      float velocity = 1.f;
+      float target_weight = 1.f;
+      if( !parse_target( serialized, filename, note, velocity, target_weight ) ) {
+        std::cerr << "Invalid target " << serialized << std::endl;
+        return -1;
+      }
+      targets.emplace_back( note, velocity, target_weight );
+      targets.back().references = create_references( window, load_monoral( filename, resample_taps ), weight, interval, quantized, band_count, band, precision );
+    }
+  }
+  const auto audio = load_monoral( input_filename, resample_taps );
   const int x = 256;
   /*const std::array< spectrum_image, 14 > references{{
     spectrum_image( window, audio, 32, 44100, 128, 2 ),
@@ -101,24 +474,23 @@ int main( int argc, char* argv[] ) {
     spectrum_image( window, audio, 2048, 44100, 8192, 300 ),
     spectrum_image( window, audio, 4096, 44100, 8192, 900 ),
   }};*/
-  const std::array< spectrum_image, 15 > references{{
-    spectrum_image( window, audio, 32, 44100, 128, 15, weight, interval ),
-    spectrum_image( window, audio, 64, 44100, 256, 14, weight, interval ),
-    spectrum_image( window, audio, 64, 44100, 256, 13, weight, interval ),
-    spectrum_image( window, audio, 128, 44100, 512, 12, weight, interval ),
-    spectrum_image( window, audio, 128, 44100, 512, 11, weight, interval ),
-    spectrum_image( window, audio, 256, 44100, 1024, 10, weight, interval ),
-    spectrum_image( window, audio, 256, 44100, 1024, 9, weight, interval ),
-    spectrum_image( window, audio, 512, 44100, 2048, 8, weight, interval ),
-    spectrum_image( window, audio, 512, 44100, 2048,  7, weight, interval ),
-    spectrum_image( window, audio, 1024, 44100, 4096, 6, weight, interval ),
-    spectrum_image( window, audio, 1024, 44100, 4096, 5, weight, interval ),
-    spectrum_image( window, audio, 2048, 44100, 8192, 4, weight, interval ),
-    spectrum_image( window, audio, 2048, 44100, 8192, 3, weight, interval ),
-    spectrum_image( window, audio, 4096, 44100, 8192, 2, weight, interval ),
-    spectrum_image( window, audio, 4096, 44100, 8192, 1, weight, interval ),
-  }};
-  const auto &eref = references[ 14 ];
+  targets.front().references = create_references( window, audio, weight, interval, quantized, band_count, band, precision );
+  const auto &eref = targets.front().references.back();
+  const size_t level_count = targets.front().references.size();
+  const bool numa = params["numa"].as<bool>();
+  const tinyfm3::pinned_workers workers( params["jobs"].as<unsigned int>(), numa );
+  for( auto &target: targets ) {
+    target.replicas.resize( numa ? workers.get_node_count() : 0u );
+    for( size_t node = 0u; node != target.replicas.size(); ++node ) {
+      workers.on_node( node, [&]() {
+        target.replicas[ node ].reserve( target.references.size() );
+        for( const auto &r: target.references )
+          target.replicas[ node ].push_back( r.replicate() );
+      } );
+      target.node_references.push_back( target.replicas[ node ].data() );
+    }
+    if( target.node_references.empty() ) target.node_references.push_back( target.references.data() );
+  }
   const std::array< int, 15 > survive_count{{
     17,
     16,
@@ -137,97 +509,82 @@ int main( int argc, char* argv[] ) {
     10
   }};
   std::cout << "ready" << std::endl;
-  std::random_device seed_generator;
-  std::mt19937 random_generator( seed_generator() );
-  std::vector< dna > dnas( survive_count[ 0 ] * survive_count[ 0 ] );
-  double sum = 0.0;
-  size_t mipmap_level = params["mipmap"].as<int>();
   const float attack_time = ( eref.get_attack_time() - eref.get_delay_time() );
   const float release_time = ( eref.get_total_time() - eref.get_release_time() );
   std::cout << __FILE__ << " " << __LINE__ << " " << attack_time << " " << release_time << std::endl;
-  size_t stable = 0u;
-  std::vector< double > cached_scores;
-  std::vector< dna > survived;
   const bool has_release = params["has-release"].as<bool>();
-  std::vector< double > scores;
+  if( bench ) {
+    std::vector< unsigned int > levels;
+    namespace qi = boost::spirit::qi;
+    const std::string serialized_levels = params["bench-levels"].as<std::string>();
+    auto iter = serialized_levels.cbegin();
+    if( !qi::parse( iter, serialized_levels.cend(), qi::uint_ % ',', levels ) || iter != serialized_levels.cend() ) {
+      std::cerr << "Invalid mipmap levels" << std::endl;
+      return -1;
+    }
+    const unsigned int seed = params.count("seed") ? params["seed"].as<unsigned int>() : 1u;
+    const unsigned int bench_cycles = params["bench-cycle"].as<unsigned int>();
+    std::vector< benchmark_result > results;
+    for( const auto level: levels ) {
+      if( level >= level_count ) {
+        std::cerr << "Invalid mipmap level " << level << std::endl;
+        return -1;
+      }
+      results.emplace_back( run_benchmark( workers, targets, survive_count, schema, window, level, bench_cycles, seed, release_time, has_release, screening_ratio, neighbor_count ) );
+    }
+    print_benchmark( results, seed, bench_cycles );
+    return 0;
+  }
+  std::random_device seed_generator;
+  std::mt19937 random_generator( params.count("seed") ? params["seed"].as<unsigned int>() : seed_generator() );
+  population dnas( survive_count[ 0 ] * survive_count[ 0 ], schema );
+  dnas.generate( survive_count[ 0 ] * survive_count[ 0 ], random_generator );
+  if( warm_start.size() ) {
+    const auto neighbors = warm_start.nearest( preset_index::fingerprint( window, audio ), std::min( params["warm-start-count"].as<size_t>(), dnas.size() ) );
+    std::array< uint32_t, population::gene_count > genome;
+    for( size_t i = 0u; i != neighbors.size(); ++i ) {
+      schema.encode( neighbors[ i ]->config.data(), release_time, has_release, genome.data() );
+      dnas.set( i, genome.data() );
+      std::cout << "warm start: " << neighbors[ i ]->name << std::endl;
+    }
+  }
+  surrogate_model surrogate( population::gene_count, dnas.size() * 4u, neighbor_count );
+  generation_stats total;
+  size_t mipmap_level = params["mipmap"].as<int>();
+  size_t stable = 0u;
   const unsigned int cycles = params["cycle"].as<unsigned int>() + 1u;
   const unsigned int stickiness = params["stickiness"].as<unsigned int>();
   for( size_t cycle = 0u; cycle != cycles; ++cycle ) {
-    scores.clear();
-    scores.reserve( dnas.size() );
-    size_t counter = 0u;
-    //const auto begin = std::chrono::high_resolution_clock::now();
-    for( size_t i = 0u; i != dnas.size(); ++i ) {
-      if( !cached_scores.empty() && ( i % ( cached_scores.size() + 1 ) ) == 0u ) scores.push_back( cached_scores[ i / ( cached_scores.size() + 1 ) ] );
-      else {
-        const auto audio = generate_tone(
-          params["note"].as<int>(),
-          eref.get_delay_time()*tinyfm3::frequency,
-          eref.get_release_time()*tinyfm3::frequency,
-          eref.get_total_time()*tinyfm3::frequency,
-          dnas[ i ]( attack_time, release_time, has_release ),
-          has_release
-        );
-        double distance = get_distance(
-          references[ mipmap_level ],
-          window,
-          audio
-        );
-        scores.push_back( 1.0/(distance*distance) );
-      }
-    }
-    survived.clear();
-    survived.reserve( survive_count[ mipmap_level ] );
+    total += evaluate( dnas, workers, targets, mipmap_level, window, release_time, has_release, screening_ratio < 1.f ? &surrogate : nullptr, screening_ratio, survive_count[ mipmap_level ], random_generator );
     double top_score = 0.0;
     size_t top_index = 0;
-    double previous_top_score = 1.0/scores[ 0.f ];
-    cached_scores.clear();
-    cached_scores.reserve( survive_count[ mipmap_level ] );
+    double previous_top_score = 1.0/dnas.get_scores()[ 0 ];
+    bool level_changed = false;
     {
       const size_t elite_count = std::min( survive_count[ mipmap_level ], int( mipmap_level / 2u + 1u ) );
-      for( size_t i = 0u; i != elite_count; ++i ) {
-        const auto top = std::distance( scores.begin(), std::max_element( scores.begin(), scores.end() ) );
-        if( i == 0u ) {
-	  top_score = 1.0/scores[ top ];
-          top_index = top;
-	}
-        survived.emplace_back( std::move( dnas[ top ] ) );
-        cached_scores.emplace_back( scores[ top ] );
-        dnas.erase( std::next( dnas.begin(), top ) );
-        scores.erase( std::next( scores.begin(), top ) );
-      }
-      for( size_t i = 0u; i != survive_count[ mipmap_level ] - elite_count; ++i ) {
-        std::discrete_distribution< size_t > distribution( scores.begin(), scores.end() );
-        size_t pos = distribution( random_generator );
-	survived.emplace_back( std::move( dnas[ pos ] ) );
-        cached_scores.emplace_back( scores[ pos ] );
-        dnas.erase( std::next( dnas.begin(), pos ) );
-        scores.erase( std::next( scores.begin(), pos ) );
-      }
+      top_score = dnas.select( survive_count[ mipmap_level ], elite_count, random_generator, top_index );
       if( fabs( top_score - previous_top_score ) < 0.00000001 ) ++stable;
       else stable = 0u;
-      if( stable > stickiness && mipmap_level < references.size() - 1u ) {
-        cached_scores.clear();
+      if( stable > stickiness && mipmap_level < level_count - 1u ) {
+        level_changed = true;
         mipmap_level = mipmap_level + 1u;
-	stable = 0u;
+        stable = 0u;
       }
     }
-    dnas.clear();
-    const int mutation_rate = ( cycle % 20 ) ? 80+cycle/5 : 8+cycle/50;
-    for( size_t l = 0u; l != survived.size(); ++l ) {
-      for( size_t r = 0u; r != survived.size(); ++r ) {
-        if( l != r ) dnas.emplace_back( survived[ l ].crossover( survived[ r ], mutation_rate ) );
-        else dnas.emplace_back( survived[ l ] );
-      }
+    dnas.breed( get_mutation_rate( cycle ), random_generator );
+    if( level_changed ) {
+      dnas.clear_cache();
+      surrogate.clear();
     }
-    //const auto end = std::chrono::high_resolution_clock::now();
-    std::cout << cycle << " " << top_index << " " << top_score << " " << mipmap_level << /*" " << std::chrono::duration_cast< std::chrono::microseconds >( end - begin ).count() <<*/ std::endl;
+    std::cout << cycle << " " << top_index << " " << top_score << " " << mipmap_level << std::endl;
+    if( screening_ratio < 1.f )
+      std::cout << "surrogate skipped " << total.get_skipped_ratio() << " prediction error " << total.get_prediction_error() << std::endl;
     if ( !( cycle % 10 ) ) {
       namespace karma = boost::spirit::karma;
       std::string filename;
       karma::generate( std::back_inserter( filename ), karma::string << "/" << karma::right_align( 4, '0' )[ karma::uint_ ] << ".conf", boost::fusion::make_vector( output_dir, cycle ) );
       std::string serialized;
-      const auto config = survived.front()( attack_time, release_time, has_release );
+      const auto config = dnas.get_config( top_index );
       karma::real_generator< float, output_float_policy< float > > float_p;
       karma::generate( std::back_inserter( serialized ), float_p % ',', config );
       std::fstream file( filename.c_str(), std::ios::out );
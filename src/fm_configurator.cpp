@@ -9,52 +9,19 @@
 #include <string>
 #include <boost/program_options.hpp>
 #include <boost/spirit/include/qi.hpp>
-#include <sndfile.h>
 
 #include "common.hpp"
 #include "channel_state.hpp"
 #include "fm_operator.hpp"
-
-class wavesink {
-public:
-  wavesink( const char *filename ) {
-    config.frames = 0;
-    config.samplerate = tinyfm3::frequency;
-    config.channels = 1;
-    config.format = SF_FORMAT_WAV|SF_FORMAT_PCM_16;
-    config.sections = 0;
-    config.seekable = 1;
-    file = sf_open( filename, SFM_WRITE, &config );
-  }
-  ~wavesink() {
-    sf_write_sync( file );
-    sf_close( file );
-  }
-  void play_if_not_playing() const {
-  }
-  bool buffer_is_ready() const {
-    return true;
-  }
-  void operator()( const float data ) {
-    int16_t ibuf[ 1 ];
-    std::transform( &data, &data + 1, ibuf, []( const float &value ) { return int16_t( value * 32767 ); } );
-    sf_write_short( file, ibuf, 1 );
-  }
-  template< size_t i >
-  void operator()( const std::array< int16_t, i > &data ) {
-    sf_write_short( file, data.data(), i );
-  }
-private:
-  SF_INFO config;
-  SNDFILE* file;
-};
+#include "audio_sink.hpp"
 
 int main( int argc, char* argv[] ) {
   boost::program_options::options_description options("オプション");
   options.add_options()
     ("help,h",    "ヘルプを表示")
     ("config,c", boost::program_options::value<std::string>(),  "入力ファイル")
-    ("output,o", boost::program_options::value<std::string>(),  "出力ファイル")
+    ("output,o", boost::program_options::value<std::string>(),  "出力ファイル (-で標準出力)")
+    ("format,f", boost::program_options::value<std::string>()->default_value("pcm16"),  "出力形式 (pcm16|float32)")
     ("note,n", boost::program_options::value<int>()->default_value(60),  "音階")
     ("length,l", boost::program_options::value<float>()->default_value(5.f),  "長さ");
   boost::program_options::variables_map params;
@@ -82,7 +49,12 @@ int main( int argc, char* argv[] ) {
     std::cerr << "Invalid configuration 2" << std::endl;
     return -1;
   }
-  wavesink sink( output_filename.c_str() );
+  tinyfm3::sample_format format;
+  if( !tinyfm3::parse_sample_format( params["format"].as<std::string>(), format ) ) {
+    std::cerr << "Invalid format" << std::endl;
+    return -1;
+  }
+  tinyfm3::audio_sink sink( output_filename, format );
   tinyfm3::fm_config program;
   program.reset( config.begin(), config.end() );
   tinyfm3::channel_state channel( 0 );
@@ -99,5 +71,8 @@ int main( int argc, char* argv[] ) {
     sink( fm() );
     ++fm;
   }
+  sink.close();
+  sink.report( output_filename );
+  return sink.good() ? 0 : -1;
 }
 
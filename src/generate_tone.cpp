@@ -17,16 +17,16 @@
 #include "generate_tone.hpp"
 
 std::vector< int16_t > generate_tone(
-  int note, int delay, int release, int total_length, const std::vector< float > &config, bool has_release
+  int note, int delay, int release, int total_length, const float *config_begin, const float *config_end, bool has_release, float velocity
 ) {
   tinyfm3::fm_config program;
-  program.reset( config.begin(), config.end() );
+  program.reset( config_begin, config_end );
   tinyfm3::channel_state channel( 0 );
   channel.reset();
   tinyfm3::fm fm;
   std::vector< int16_t > samples( delay, 0 );
   samples.reserve( total_length );
-  fm.note_on( uint8_t( note ), 1.0f, &program, &channel );
+  fm.note_on( uint8_t( note ), velocity, &program, &channel );
   for( size_t i = delay; i != release; ++i ) {
     float v = fm();
     samples.emplace_back( v * 32767 );
@@ -41,5 +41,11 @@ std::vector< int16_t > generate_tone(
   return std::move( samples );
 }
 
+std::vector< int16_t > generate_tone(
+  int note, int delay, int release, int total_length, const std::vector< float > &config, bool has_release, float velocity
+) {
+  return generate_tone( note, delay, release, total_length, config.data(), config.data() + config.size(), has_release, velocity );
+}
+
 #endif
 
@@ -1,16 +1,63 @@
 #include <cmath>
-#include <fstream>
+#include <cstring>
 #include <iostream>
-#include <fstream>
 #include <vector>
-#include <complex>
-#include <tuple>
 #include <algorithm>
 #include <sndfile.h>
 
+#include "common.hpp"
+#include "resampler.hpp"
 #include "load_monoral.hpp"
 
-std::vector< int16_t > load_monoral( const std::string &filename ) {
+namespace {
+  constexpr sf_count_t chunk_frames = 4096;
+  inline uint32_t get_magnitude( float v ) {
+    uint32_t bits;
+    std::memcpy( &bits, &v, sizeof( bits ) );
+    return bits & 0x7FFFFFFFu;
+  }
+  float downmix( const float *input, float *output, size_t frames, int channels ) {
+    uint32_t peak = 0u;
+    if( channels == 1 ) {
+      for( size_t i = 0u; i != frames; ++i ) {
+        output[ i ] = input[ i ];
+        peak = std::max( peak, get_magnitude( output[ i ] ) );
+      }
+    }
+    else if( channels == 2 ) {
+      for( size_t i = 0u; i != frames; ++i ) {
+        output[ i ] = ( input[ i * 2u ] + input[ i * 2u + 1u ] ) * 0.5f;
+        peak = std::max( peak, get_magnitude( output[ i ] ) );
+      }
+    }
+    else {
+      const float scale = 1.f / channels;
+      for( size_t i = 0u; i != frames; ++i ) {
+        float sum = 0.f;
+        for( int c = 0; c != channels; ++c )
+          sum += input[ i * channels + c ];
+        output[ i ] = sum * scale;
+        peak = std::max( peak, get_magnitude( output[ i ] ) );
+      }
+    }
+    float magnitude;
+    std::memcpy( &magnitude, &peak, sizeof( magnitude ) );
+    return magnitude;
+  }
+  float get_peak( const float *data, size_t size ) {
+    uint32_t peak = 0u;
+    for( size_t i = 0u; i != size; ++i )
+      peak = std::max( peak, get_magnitude( data[ i ] ) );
+    float magnitude;
+    std::memcpy( &magnitude, &peak, sizeof( magnitude ) );
+    return magnitude;
+  }
+  bool is_audible( float v ) {
+    return std::fabs( v ) * 32768.f >= 1.f;
+  }
+}
+
+std::vector< int16_t > load_monoral( const std::string &filename, size_t resample_taps ) {
   SF_INFO info;
   info.frames = 0;
   info.samplerate = 0;
@@ -23,39 +70,56 @@ std::vector< int16_t > load_monoral( const std::string &filename ) {
     std::cerr << "Unable to open audio file" << std::endl;
     throw -1;
   }
-  std::vector< int16_t > monoral;
-  std::vector< int16_t > multi_channel;
-  multi_channel.resize( info.frames * info.channels );
-  const auto read_count = sf_read_short( audio_file, multi_channel.data(), info.frames * info.channels );
-  if( read_count == 0u ) {
-    std::cerr << "Unable to read audio file" << std::endl;
+  if( info.channels <= 0 ) {
+    sf_close( audio_file );
+    std::cerr << "Invalid audio file" << std::endl;
     throw -1;
   }
+  tinyfm3::polyphase_resampler resampler( info.samplerate > 0 ? info.samplerate : tinyfm3::frequency, tinyfm3::frequency, resample_taps );
+  std::vector< float > chunk( chunk_frames * info.channels );
+  std::vector< float > mixed( chunk_frames );
+  std::vector< float > resampled;
+  std::vector< float > monoral;
+  monoral.reserve( std::max( info.frames, sf_count_t( 0 ) ) * tinyfm3::frequency / std::max( info.samplerate, 1 ) );
+  sf_count_t total = 0;
+  float peak = 0.f;
+  const auto append = [&]( const float *begin, const float *end ) {
+    if( monoral.empty() )
+      begin = std::find_if( begin, end, is_audible );
+    monoral.insert( monoral.end(), begin, end );
+  };
+  while( 1 ) {
+    const auto read_count = sf_readf_float( audio_file, chunk.data(), chunk_frames );
+    if( read_count <= 0 ) break;
+    total += read_count;
+    const float chunk_peak = downmix( chunk.data(), mixed.data(), read_count, info.channels );
+    if( resampler.is_identity() ) {
+      peak = std::max( peak, chunk_peak );
+      append( mixed.data(), std::next( mixed.data(), read_count ) );
+    }
+    else {
+      resampled.clear();
+      resampler( mixed.data(), read_count, resampled );
+      peak = std::max( peak, get_peak( resampled.data(), resampled.size() ) );
+      append( resampled.data(), std::next( resampled.data(), resampled.size() ) );
+    }
+  }
   sf_close( audio_file );
-  if( read_count % info.channels != 0 ) {
-    std::cerr << "Invalid audio file" << std::endl;
+  if( !resampler.is_identity() ) {
+    resampled.clear();
+    resampler.flush( resampled );
+    peak = std::max( peak, get_peak( resampled.data(), resampled.size() ) );
+    append( resampled.data(), std::next( resampled.data(), resampled.size() ) );
+  }
+  if( total == 0 ) {
+    std::cerr << "Unable to read audio file" << std::endl;
     throw -1;
   }
-  multi_channel.resize( read_count );
-  monoral.reserve( read_count / info.channels );
-  for( auto iter = multi_channel.begin(); iter != multi_channel.end(); ) {
-    auto next_iter = std::next( iter, info.channels );
-    monoral.emplace_back( std::accumulate( iter, next_iter, int16_t( 0 ) ) / info.channels );
-    iter = next_iter;
-  }
-  const auto audio_begin = std::find_if( monoral.begin(), monoral.end(), []( int16_t v ) { return v != 0; } );
-  monoral.erase( monoral.begin(), audio_begin );
-  const auto max_iter = std::max_element( monoral.begin(), monoral.end() );
-  const auto min_iter = std::min_element( monoral.begin(), monoral.end() );
-  const int16_t max =
-    std::max(
-      ( max_iter != monoral.end() ) ? std::abs( *max_iter ) : int16_t( 0 ),
-      ( min_iter != monoral.end() ) ? std::abs( *min_iter ) : int16_t( 0 )
-    );
-  if( max != 0 ) {
-    for( auto &elem: monoral )
-      elem = int32_t( elem ) * 32768 / max;
-  }
-  return monoral;
+  const float scale = is_audible( peak ) ? 32767.f / peak : 32768.f;
+  std::vector< int16_t > quantized( monoral.size() );
+  std::transform( monoral.begin(), monoral.end(), quantized.begin(), [scale]( float v ) {
+    return int16_t( std::min( std::max( std::nearbyint( v * scale ), -32768.f ), 32767.f ) );
+  } );
+  return quantized;
 }
 
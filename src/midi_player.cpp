@@ -6,54 +6,30 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <array>
+#include <vector>
+#include <memory>
 #include <iostream>
 #include <boost/program_options.hpp>
+#include <boost/spirit/include/karma.hpp>
 #include "envelope.hpp"
 #include "fm_operator.hpp"
 #include "note_mapper.hpp"
 #include "midi_player.hpp"
-#include "midi_sequencer2.hpp"
-#include <sndfile.h>
+#include "channel_renderer.hpp"
+#include "midi_timeline.hpp"
+#include "audio_sink.hpp"
 
-class wavesink {
-public:
-  wavesink( const char *filename ) {
-    config.frames = 0;
-    config.samplerate = tinyfm3::frequency;
-    config.channels = 1;
-    config.format = SF_FORMAT_WAV|SF_FORMAT_PCM_16;
-    config.sections = 0;
-    config.seekable = 1;
-    file = sf_open( filename, SFM_WRITE, &config );
-  }
-  ~wavesink() {
-    sf_write_sync( file );
-    sf_close( file );
-  }
-  void play_if_not_playing() const {
-  }
-  bool buffer_is_ready() const {
-    return true;
-  }
-  void operator()( const float data ) {
-    int16_t ibuf[ 1 ];
-    std::transform( &data, &data + 1, ibuf, []( const float &value ) { return int16_t( value * 32767 ); } );
-    sf_write_short( file, ibuf, 1 );
-  }
-  template< size_t i >
-  void operator()( const std::array< int16_t, i > &data ) {
-    sf_write_short( file, data.data(), i );
-  }
-private:
-  SF_INFO config;
-  SNDFILE* file;
-};
 int main( int argc, char* argv[] ) {
   boost::program_options::options_description options("オプション");
   options.add_options()
     ("help,h",    "ヘルプを表示")
     ("input,i", boost::program_options::value<std::string>(),  "入力ファイル")
-    ("output,o", boost::program_options::value<std::string>(),  "出力ファイル");
+    ("output,o", boost::program_options::value<std::string>(),  "出力ファイル (-で標準出力)")
+    ("format,f", boost::program_options::value<std::string>()->default_value("pcm16"),  "出力形式 (pcm16|float32)")
+    ("jobs,j", boost::program_options::value<unsigned int>()->default_value(1),  "チャンネルを分担して描画するスレッド数 (発音数の上限はチャンネルのグループ毎に適用されるため、ボイスの奪い合いが起きる曲は1スレッドの描画と一致しない)")
+    ("stem,s", boost::program_options::value<std::string>(),  "チャンネル毎の出力ファイルの接頭辞 (発音数の上限はチャンネル毎に適用される)")
+    ("slices,t", boost::program_options::value<unsigned int>()->default_value(0),  "曲を時間で分割して並列に描画する数")
+    ("warmup,w", boost::program_options::value<float>()->default_value(0.1f),  "分割描画の前に捨てる秒数 (音量正規化などの状態を揃えるため0にはしない)");
   boost::program_options::variables_map params;
   boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
   boost::program_options::notify( params );
@@ -63,37 +39,74 @@ int main( int argc, char* argv[] ) {
   }
   const std::string input_filename = params["input"].as<std::string>();
   const std::string output_filename = params["output"].as<std::string>();
-  wavesink sink( output_filename.c_str() );
-  tinyfm3::midi_sequencer< const uint8_t* > seq;
+  const unsigned int jobs = params["jobs"].as<unsigned int>();
+  tinyfm3::sample_format format;
+  if( !tinyfm3::parse_sample_format( params["format"].as<std::string>(), format ) ) {
+    std::cerr << "Invalid format" << std::endl;
+    return -1;
+  }
   const int fd = open( input_filename.c_str(), O_RDONLY );
   if( fd < 0 ) {
-    std::cout << __FILE__ << " " << __LINE__ << std::endl;
+    std::cerr << __FILE__ << " " << __LINE__ << std::endl;
     return -1;
   }
   struct stat buf;
   if( fstat( fd, &buf ) < 0 ) {
-    std::cout << __FILE__ << " " << __LINE__ << std::endl;
+    std::cerr << __FILE__ << " " << __LINE__ << std::endl;
     return -1;
   }
   void * const mapped = mmap( NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
   if( mapped == nullptr ) {
-    std::cout << __FILE__ << " " << __LINE__ << std::endl;
+    std::cerr << __FILE__ << " " << __LINE__ << std::endl;
     return -1;
   }
   const auto midi_begin = reinterpret_cast< uint8_t* >( mapped );
   const auto midi_end = std::next( midi_begin, buf.st_size );
-  if( !seq.load( midi_begin, midi_end ) ) {
-    std::cout << __FILE__ << " " << __LINE__ << std::endl;
+  const unsigned int slices = params["slices"].as<unsigned int>();
+  if( slices ) {
+    if( params.count("stem") ) {
+      std::cerr << "--slices cannot be combined with --stem" << std::endl;
+      return -1;
+    }
+    tinyfm3::midi_timeline timeline;
+    if( !timeline.load( midi_begin, midi_end ) ) {
+      std::cerr << __FILE__ << " " << __LINE__ << std::endl;
+      return -1;
+    }
+    tinyfm3::audio_sink sink( output_filename, format );
+    std::vector< float > output( ( timeline.get_length() / 16000u + 1u ) * 16000u );
+    tinyfm3::render_timeline( timeline, output.begin(), output.size(), slices, uint64_t( params["warmup"].as<float>() * tinyfm3::frequency ) );
+    sink( output );
+    sink.close();
+    sink.report( output_filename );
+    return sink.good() ? 0 : -1;
+  }
+  tinyfm3::channel_renderer< const uint8_t* > renderer( params.count("stem") ? 16u : std::max( std::min( jobs, 16u ), 1u ), jobs );
+  if( !renderer.load( midi_begin, midi_end ) ) {
+    std::cerr << __FILE__ << " " << __LINE__ << std::endl;
     return -1;
   }
-  std::array< int16_t, 16000u > buffer;
-  while( !seq.is_end() ) {
-    auto begin = buffer.begin();
-    auto end = std::next( buffer.begin(), 16u );
-    for( ; begin != buffer.end(); begin += 16, end += 16 ) {
-      seq( begin, end );
+  tinyfm3::audio_sink sink( output_filename, format );
+  std::vector< std::unique_ptr< tinyfm3::audio_sink > > stems;
+  if( params.count("stem") ) {
+    for( unsigned int channel = 0u; channel != renderer.get_group_count(); ++channel ) {
+      std::string filename;
+      namespace karma = boost::spirit::karma;
+      karma::generate( std::back_inserter( filename ), karma::string << karma::right_align( 2, '0' )[ karma::uint_ ] << ".wav", boost::fusion::make_vector( params["stem"].as<std::string>(), channel ) );
+      stems.emplace_back( new tinyfm3::audio_sink( filename, format ) );
     }
-    sink( buffer );
   }
+  while( !renderer.is_end() ) {
+    renderer( 16000u );
+    sink( renderer.get_mix() );
+    for( unsigned int channel = 0u; channel != stems.size(); ++channel )
+      ( *stems[ channel ] )( renderer.get_stem( channel ) );
+  }
+  sink.close();
+  sink.report( output_filename );
+  for( const auto &stem: stems ) {
+    stem->close();
+    if( !stem->good() ) return -1;
+  }
+  return sink.good() ? 0 : -1;
 }
-
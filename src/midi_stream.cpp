@@ -0,0 +1,112 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <array>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <boost/program_options.hpp>
+#include "midi_player.hpp"
+#include "realtime_engine.hpp"
+#include "audio_sink.hpp"
+
+class sink_output : public tinyfm3::output_backend {
+public:
+  sink_output( tinyfm3::audio_sink &sink_ ) : sink( sink_ ) {}
+  void operator()( const float *data, size_t size ) override {
+    sink( data, std::next( data, size ) );
+  }
+private:
+  tinyfm3::audio_sink &sink;
+};
+
+int open_input( const boost::program_options::variables_map &params ) {
+  if( params.count("port") ) {
+    const int server = socket( AF_INET, SOCK_STREAM, 0 );
+    if( server < 0 ) return -1;
+    const int reuse = 1;
+    setsockopt( server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) );
+    sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl( INADDR_ANY );
+    addr.sin_port = htons( params["port"].as<uint16_t>() );
+    if( bind( server, reinterpret_cast< sockaddr* >( &addr ), sizeof( addr ) ) < 0 || listen( server, 1 ) < 0 ) {
+      close( server );
+      return -1;
+    }
+    const int client = accept( server, nullptr, nullptr );
+    close( server );
+    return client;
+  }
+  const std::string input_filename = params["input"].as<std::string>();
+  if( input_filename == "-" ) return STDIN_FILENO;
+  return open( input_filename.c_str(), O_RDONLY );
+}
+
+int main( int argc, char* argv[] ) {
+  boost::program_options::options_description options("オプション");
+  options.add_options()
+    ("help,h",    "ヘルプを表示")
+    ("input,i", boost::program_options::value<std::string>(),  "MIDIバイト列を読むFIFO (-で標準入力)")
+    ("port,p", boost::program_options::value<uint16_t>(),  "MIDIバイト列を受け付けるTCPポート")
+    ("output,o", boost::program_options::value<std::string>(),  "出力ファイル (-で標準出力、省略時は破棄)")
+    ("format,f", boost::program_options::value<std::string>()->default_value("pcm16"),  "出力形式 (pcm16|float32)")
+    ("block,b", boost::program_options::value<size_t>()->default_value(256u),  "ブロックのサンプル数")
+    ("blocks,n", boost::program_options::value<size_t>()->default_value(4u),  "リングバッファのブロック数")
+    ("tail,t", boost::program_options::value<float>()->default_value(1.f),  "入力終了後に鳴らし続ける秒数");
+  boost::program_options::variables_map params;
+  boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
+  boost::program_options::notify( params );
+  if( params.count("help") || ( !params.count("input") && !params.count("port") ) ) {
+    std::cout << options << std::endl;
+    return 0;
+  }
+  tinyfm3::sample_format format;
+  if( !tinyfm3::parse_sample_format( params["format"].as<std::string>(), format ) ) {
+    std::cerr << "Invalid format" << std::endl;
+    return -1;
+  }
+  std::unique_ptr< tinyfm3::audio_sink > sink;
+  std::unique_ptr< tinyfm3::output_backend > output;
+  if( params.count("output") ) {
+    sink.reset( new tinyfm3::audio_sink( params["output"].as<std::string>(), format ) );
+    output.reset( new sink_output( *sink ) );
+  }
+  else output.reset( new tinyfm3::null_output() );
+  const int fd = open_input( params );
+  if( fd < 0 ) {
+    std::cerr << "Unable to open MIDI input" << std::endl;
+    return -1;
+  }
+  tinyfm3::realtime_engine engine( *output, params["block"].as<size_t>(), params["blocks"].as<size_t>() );
+  engine.start();
+  std::array< uint8_t, 256u > buffer;
+  while( 1 ) {
+    const auto length = read( fd, buffer.data(), buffer.size() );
+    if( length <= 0 ) break;
+    for( ssize_t i = 0; i != length; ++i )
+      while( !engine.push( buffer[ i ] ) )
+        std::this_thread::yield();
+  }
+  if( fd != STDIN_FILENO ) close( fd );
+  std::this_thread::sleep_for( std::chrono::duration< float >( params["tail"].as<float>() ) );
+  engine.stop();
+  if( sink ) {
+    sink->close();
+    sink->report( params["output"].as<std::string>() );
+  }
+  const auto &stats = engine.get_stats();
+  std::cerr << "blocks " << stats.blocks
+    << " underruns " << stats.underruns
+    << " events " << stats.events
+    << " latency mean " << ( stats.latency_count ? stats.latency_sum / stats.latency_count : 0.0 )
+    << " max " << stats.latency_max
+    << " render mean " << ( stats.rendered ? stats.render_sum / stats.rendered : 0.0 )
+    << " max " << stats.render_max << std::endl;
+  return 0;
+}
+
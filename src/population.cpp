@@ -0,0 +1,197 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#include "population.hpp"
+
+static inline float fast_exp2( float v ) {
+  const float r = std::floor( v + 0.5f );
+  const float f = v - r;
+  const float p = 1.f + f * ( 0.693147181f + f * ( 0.240226507f + f * ( 0.0555041087f + f * ( 0.00961812911f + f * ( 0.00133335581f + f * 0.000154035304f ) ) ) ) );
+  const int32_t bits = ( int32_t( r ) + 127 ) << 23;
+  float scale;
+  std::memcpy( &scale, &bits, sizeof( scale ) );
+  return p * scale;
+}
+
+population::population( size_t capacity_, const tinyfm3::genome_schema &schema_ ) :
+  schema( schema_ ), capacity( capacity_ ), count( 0u ), current( 0u ),
+  scores( capacity_ ), cached( capacity_ ), bits( capacity_ ), configs( capacity_ * config_size ) {
+  genes[ 0 ].resize( capacity * gene_count );
+  genes[ 1 ].resize( capacity * gene_count );
+}
+
+void population::generate( size_t size, std::mt19937 &random_generator ) {
+  std::uniform_int_distribution< uint32_t > distribution( 0u, std::numeric_limits< uint32_t >::max() );
+  count = size;
+  for( size_t i = 0u; i != count; ++i ) {
+    for( size_t gene = 0u; gene != gene_count; ++gene ) {
+      const auto &spec = schema[ gene ];
+      if( spec.locked ) get_genes( current, gene )[ i ] = 0u;
+      else get_genes( current, gene )[ i ] = tinyfm3::encode_gene( spec.encoding, ( distribution( random_generator ) & spec.init_and ) | spec.init_or );
+    }
+  }
+  clear_cache();
+}
+
+const float *population::decode( float release, bool has_release ) {
+  const float unit = float( 1.0 / std::numeric_limits< uint32_t >::max() );
+  float *dest = configs.data();
+  std::fill( dest, dest + count * config_size, 0.f );
+  for( size_t gene = 0u; gene != gene_count; ++gene ) {
+    const auto &spec = schema[ gene ];
+    float *d = dest + spec.field;
+    if( spec.locked ) {
+      for( size_t i = 0u; i != count; ++i )
+        d[ i * config_size ] = spec.constant;
+      continue;
+    }
+    const uint32_t *g = get_genes( current, gene );
+    if( spec.encoding != tinyfm3::gene_encoding::binary ) {
+      for( size_t i = 0u; i != count; ++i )
+        bits[ i ] = tinyfm3::decode_gene( spec.encoding, g[ i ] );
+      g = bits.data();
+    }
+    const float s = ( spec.high - spec.low ) * unit;
+    if( spec.scale == tinyfm3::gene_scale::linear ) {
+      for( size_t i = 0u; i != count; ++i )
+        d[ i * config_size ] = spec.low + float( g[ i ] ) * s;
+    }
+    else if( spec.scale == tinyfm3::gene_scale::exp2 ) {
+      for( size_t i = 0u; i != count; ++i )
+        d[ i * config_size ] = fast_exp2( spec.low + float( g[ i ] ) * s );
+    }
+    else if( spec.scale == tinyfm3::gene_scale::release ) {
+      for( size_t i = 0u; i != count; ++i )
+        d[ i * config_size ] = ( spec.low + float( g[ i ] ) * s ) * release;
+    }
+    else {
+      const uint32_t choices = uint32_t( spec.high );
+      for( size_t i = 0u; i != count; ++i )
+        d[ i * config_size ] = float( ( g[ i ] >> 24 ) % choices );
+    }
+  }
+  for( size_t oper = 0u; oper != 4u; ++oper ) {
+    const size_t field = 6u + 16u * oper;
+    for( size_t i = 0u; i != count; ++i ) {
+      float *c = dest + i * config_size + field;
+      if( !has_release ) c[ 9 ] = c[ 7 ];
+      const float scale = 1.f / ( std::min( 1.f, c[ 10 ] + c[ 11 ] + c[ 12 ] + c[ 13 ] ) * 1.5f );
+      c[ 10 ] *= scale;
+      c[ 11 ] *= scale;
+      c[ 12 ] *= scale;
+      c[ 13 ] *= scale;
+    }
+  }
+  return dest;
+}
+
+std::vector< float > population::get_config( size_t i ) const {
+  return std::vector< float >( std::next( configs.begin(), i * config_size ), std::next( configs.begin(), ( i + 1u ) * config_size ) );
+}
+
+void population::set( size_t i, const uint32_t *genome ) {
+  for( size_t gene = 0u; gene != gene_count; ++gene )
+    get_genes( current, gene )[ i ] = genome[ gene ];
+  cached[ i ] = 0u;
+}
+
+void population::get_parameters( size_t i, float *dest ) const {
+  const float unit = float( 1.0 / std::numeric_limits< uint32_t >::max() );
+  for( size_t gene = 0u; gene != gene_count; ++gene ) {
+    const auto &spec = schema[ gene ];
+    if( spec.locked ) {
+      dest[ gene ] = 0.f;
+      continue;
+    }
+    const uint32_t g = tinyfm3::decode_gene( spec.encoding, get_genes( current, gene )[ i ] );
+    if( spec.scale == tinyfm3::gene_scale::choice ) dest[ gene ] = float( ( g >> 24 ) % uint32_t( spec.high ) ) / spec.high;
+    else dest[ gene ] = float( g ) * unit;
+  }
+}
+
+double population::select( size_t survive_count, size_t elite_count, std::mt19937 &random_generator, size_t &top_index ) {
+  survivors.clear();
+  survivor_scores.clear();
+  taken.assign( count, 0u );
+  double top_score = 0.0;
+  for( size_t e = 0u; e != elite_count; ++e ) {
+    size_t top = count;
+    for( size_t i = 0u; i != count; ++i )
+      if( !taken[ i ] && ( top == count || scores[ i ] > scores[ top ] ) ) top = i;
+    if( e == 0u ) {
+      top_score = 1.0/scores[ top ];
+      top_index = top;
+    }
+    taken[ top ] = 1u;
+    survivors.push_back( top );
+    survivor_scores.push_back( scores[ top ] );
+  }
+  weights.assign( scores.begin(), std::next( scores.begin(), count ) );
+  for( const auto s: survivors ) weights[ s ] = 0.0;
+  for( size_t e = elite_count; e != survive_count; ++e ) {
+    std::discrete_distribution< size_t > distribution( weights.begin(), weights.end() );
+    size_t pos = distribution( random_generator );
+    if( weights[ pos ] == 0.0 ) {
+      size_t found = pos;
+      while( found != 0u && weights[ found ] == 0.0 ) --found;
+      if( weights[ found ] == 0.0 ) {
+        found = pos;
+        while( found + 1u != count && weights[ found ] == 0.0 ) ++found;
+      }
+      pos = found;
+    }
+    weights[ pos ] = 0.0;
+    survivors.push_back( pos );
+    survivor_scores.push_back( scores[ pos ] );
+  }
+  return top_score;
+}
+
+void population::breed( int mutation_rate, std::mt19937 &random_generator ) {
+  std::uniform_int_distribution< uint32_t > distribution( 0u, std::numeric_limits< uint32_t >::max() );
+  const uint32_t threshold = std::numeric_limits< uint32_t >::max()/mutation_rate;
+  const size_t next = 1u - current;
+  const size_t n = survivors.size();
+  std::array< uint32_t, gene_count > generated;
+  for( size_t l = 0u; l != n; ++l ) {
+    for( size_t r = 0u; r != n; ++r ) {
+      const size_t child = l * n + r;
+      if( l != r ) {
+        for( size_t gene = 0u; gene != gene_count; ++gene ) {
+          if( schema[ gene ].locked ) {
+            generated[ gene ] = 0u;
+            continue;
+          }
+          const uint32_t mask = distribution( random_generator );
+          generated[ gene ] = ( get_genes( current, gene )[ survivors[ l ] ] & mask ) | ( get_genes( current, gene )[ survivors[ r ] ] & ~mask );
+        }
+        for( size_t gene = 0u; gene != gene_count; ++gene ) {
+          if( schema[ gene ].locked ) continue;
+          for( size_t b = 0u; b != 32u; ++b ) {
+            if( distribution( random_generator ) < threshold )
+              generated[ gene ] ^= 1u << b;
+          }
+        }
+        for( size_t gene = 0u; gene != gene_count; ++gene )
+          get_genes( next, gene )[ child ] = generated[ gene ];
+      }
+      else {
+        for( size_t gene = 0u; gene != gene_count; ++gene )
+          get_genes( next, gene )[ child ] = get_genes( current, gene )[ survivors[ l ] ];
+      }
+    }
+  }
+  current = next;
+  count = n * n;
+  std::fill( cached.begin(), cached.end(), 0u );
+  for( size_t l = 0u; l != n; ++l ) {
+    scores[ l * n + l ] = survivor_scores[ l ];
+    cached[ l * n + l ] = 1u;
+  }
+}
+
+void population::clear_cache() {
+  std::fill( cached.begin(), cached.end(), 0u );
+}
@@ -0,0 +1,116 @@
+#include <cmath>
+#include <limits>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <numeric>
+#include <boost/spirit/include/qi.hpp>
+#include <boost/spirit/include/karma.hpp>
+
+#include "preset_index.hpp"
+
+template <typename T>
+struct index_float_policy : boost::spirit::karma::real_policies< T >
+{
+  static unsigned precision(T) { return 9u; }
+};
+
+bool load_config( const std::string &filename, std::vector< float > &config ) {
+  namespace qi = boost::spirit::qi;
+  std::ifstream config_file( filename );
+  if( !config_file.good() ) return false;
+  const auto serialized_config = std::string(
+    std::istreambuf_iterator<char>( config_file ),
+    std::istreambuf_iterator<char>()
+  );
+  config.clear();
+  auto iter = serialized_config.cbegin();
+  if( !qi::parse( iter, serialized_config.cend(), qi::skip( +qi::standard::space )[ qi::float_ % ',' ], config ) ) return false;
+  return config.size() == 70u;
+}
+
+std::vector< float > preset_index::fingerprint( const window_list_t &window, const std::vector< int16_t > &audio ) {
+  const tinyfm3::frame_table frames( 128u, powf( 2.f, 10.f ), 30.f, audio.size() );
+  const auto converted = fftref( window, frames, audio, spectrum_size );
+  const auto &envelope = converted.first;
+  const size_t batch = envelope.size();
+  const auto rows = fftfetch( converted.second.get(), batch * spectrum_size );
+  std::vector< float > fp( spectrum_size + envelope_size, 0.f );
+  for( size_t i = 0u; i != batch; ++i ) {
+    const float *row = rows.data() + i * spectrum_size;
+    for( size_t j = 0u; j != spectrum_size; ++j )
+      fp[ j ] += std::log10( 1.f + row[ j ] );
+  }
+  const float spectrum_norm = std::sqrt( std::inner_product( fp.begin(), std::next( fp.begin(), spectrum_size ), fp.begin(), 0.f ) );
+  if( spectrum_norm != 0.f )
+    for( size_t j = 0u; j != spectrum_size; ++j ) fp[ j ] /= spectrum_norm;
+  const float peak = batch ? *std::max_element( envelope.begin(), envelope.end() ) : 0.f;
+  if( peak != 0.f ) {
+    for( size_t j = 0u; j != envelope_size; ++j )
+      fp[ spectrum_size + j ] = envelope[ j * batch / envelope_size ] / peak;
+  }
+  return fp;
+}
+
+void preset_index::add( const std::string &name, std::vector< float > &&fingerprint, const std::vector< float > &config ) {
+  entries.push_back( entry{ name, std::move( fingerprint ), config } );
+}
+
+bool preset_index::load( const std::string &filename ) {
+  namespace qi = boost::spirit::qi;
+  std::ifstream file( filename );
+  if( !file.good() ) return false;
+  std::vector< entry > loaded;
+  std::string line;
+  while( std::getline( file, line ) ) {
+    if( line.empty() ) continue;
+    const size_t first = line.find( '\t' );
+    if( first == std::string::npos ) return false;
+    const size_t second = line.find( '\t', first + 1u );
+    if( second == std::string::npos ) return false;
+    entry e;
+    e.name = line.substr( 0u, first );
+    auto iter = std::next( line.cbegin(), first + 1u );
+    const auto fingerprint_end = std::next( line.cbegin(), second );
+    if( !qi::parse( iter, fingerprint_end, qi::float_ % ',', e.fingerprint ) || iter != fingerprint_end ) return false;
+    iter = std::next( line.cbegin(), second + 1u );
+    if( !qi::parse( iter, line.cend(), qi::float_ % ',', e.config ) ) return false;
+    if( e.fingerprint.size() != spectrum_size + envelope_size || e.config.size() != 70u ) return false;
+    loaded.push_back( std::move( e ) );
+  }
+  entries.insert( entries.end(), std::make_move_iterator( loaded.begin() ), std::make_move_iterator( loaded.end() ) );
+  return true;
+}
+
+bool preset_index::save( const std::string &filename ) const {
+  namespace karma = boost::spirit::karma;
+  std::ofstream file( filename );
+  if( !file.good() ) return false;
+  karma::real_generator< float, index_float_policy< float > > float_p;
+  for( const auto &e: entries ) {
+    std::string serialized;
+    karma::generate( std::back_inserter( serialized ), float_p % ',', e.fingerprint );
+    serialized += '\t';
+    karma::generate( std::back_inserter( serialized ), float_p % ',', e.config );
+    file << e.name << '\t' << serialized << std::endl;
+  }
+  return file.good();
+}
+
+std::vector< const preset_index::entry* > preset_index::nearest( const std::vector< float > &fingerprint, size_t count ) const {
+  std::vector< std::pair< float, const entry* > > distances;
+  distances.reserve( entries.size() );
+  for( const auto &e: entries ) {
+    if( e.fingerprint.size() != fingerprint.size() ) continue;
+    float d = 0.f;
+    for( size_t i = 0u; i != fingerprint.size(); ++i )
+      d += ( e.fingerprint[ i ] - fingerprint[ i ] ) * ( e.fingerprint[ i ] - fingerprint[ i ] );
+    distances.emplace_back( d, &e );
+  }
+  count = std::min( count, distances.size() );
+  std::partial_sort( distances.begin(), std::next( distances.begin(), count ), distances.end(),
+    []( const std::pair< float, const entry* > &l, const std::pair< float, const entry* > &r ) { return l.first < r.first; } );
+  std::vector< const entry* > found;
+  for( size_t i = 0u; i != count; ++i ) found.push_back( distances[ i ].second );
+  return found;
+}
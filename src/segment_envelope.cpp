@@ -9,47 +9,66 @@
 
 #include "segment_envelope.hpp"
 
-std::tuple< int, int, int > segment_envelope( const std::vector< float > &input, float a, float b ) {
-  if( input.size() <= 1u ) {
-//    std::cout << "oops0 " << input.size() << std::endl;
-    return std::make_tuple( 0, 0, 0 );
+namespace {
+  inline float get_grad( const float *input, size_t i, float a, float b ) {
+    if( i == 0u ) return 0.f;
+    return ( input[ i ] - input[ i - 1u ] )/( 2.f * a * i + b );
   }
-  std::vector< float > grad;
-  grad.emplace_back( 0.f );
-  for( size_t i = 1u; i != input.size(); ++i )
-    grad.emplace_back( ( input[ i ] - input[ i - 1u ] )/( 2.f * a * i + b ) );
-  std::vector< float > release( input.size(), 0 );
-  const auto blank_iter = std::find_if( input.rbegin(), input.rend(), []( float v ) { return v != 0; } );
-  if( blank_iter == input.rend() ) {
-//    std::cout << "oops1" << std::endl;
+}
 
-    return std::make_tuple( 0, 0, int( input.size() - 1 ) );
+std::tuple< int, int, int > segment_envelope( const float *input, size_t size, float a, float b ) {
+  if( size <= 1u ) {
+    return std::make_tuple( 0, 0, 0 );
   }
-  const auto blank = std::distance( input.rbegin(), blank_iter ) + 1;
-  float min_grad = std::abs( grad[ input.size() - ( 1 + blank ) ] );
-  float max_release = 0.f;
-  size_t end_pos = input.size() - blank;
-  for( size_t i = 1u; i != end_pos; ++i ) {
-    min_grad = std::min( min_grad, std::max( 0.f, -grad[ input.size() - ( i + blank ) ] ) );
-    release[ input.size() - ( i + blank ) ] = min_grad * ( 2.f * a * ( end_pos - i ) + b );
-    max_release = std::max( release[ input.size() - ( i + blank ) ], max_release );
+  size_t end_pos = size;
+  while( end_pos != 0u && input[ end_pos - 1u ] == 0 ) --end_pos;
+  if( end_pos == 0u ) {
+    return std::make_tuple( 0, 0, int( size - 1 ) );
+  }
+  --end_pos;
+  ptrdiff_t release_pos = ptrdiff_t( size - 1 );
+  if( end_pos != 0u ) {
+    float min_grad = std::abs( get_grad( input, end_pos - 1u, a, b ) );
+    float max_release = 0.f;
+    for( size_t i = end_pos - 1u; i != 0u; --i ) {
+      min_grad = std::min( min_grad, std::max( 0.f, -get_grad( input, i, a, b ) ) );
+      const float release = min_grad * ( 2.f * a * i + b );
+      max_release = std::max( release, max_release );
+      if( release == max_release ) release_pos = ptrdiff_t( i );
+    }
+    if( max_release == 0.f ) release_pos = ptrdiff_t( size - 1 );
+  }
+  const float max = *std::max_element( input, std::next( input, release_pos ) );
+  const float *p0 = std::next( input, release_pos );
+  const float *p1 = std::next( input, release_pos );
+  for( const float *cur = input; cur != std::next( input, release_pos ); ++cur ) {
+    if( p0 == std::next( input, release_pos ) && *cur >= max * 0.2f ) p0 = cur;
+    if( *cur >= max * 0.4f ) {
+      p1 = cur;
+      break;
+    }
   }
-  const auto release_pos = ( max_release != 0.f ) ? std::distance( release.begin(), std::max_element( release.begin(), release.end() ) ) : int( input.size() - 1 );
-  float delay = 0.f;
-  const float max = *std::max_element( input.begin(), std::next( input.begin(), release_pos ) );
-  const auto p0 = std::find_if( input.begin(), std::next( input.begin(), release_pos ), [&]( float v ){ return v >= max * 0.2f; } );
-  const auto p1 = std::find_if( input.begin(), std::next( input.begin(), release_pos ), [&]( float v ){ return v >= max * 0.4f; } );
   const auto tangent = float( std::distance( p0, p1 ) )/( *p1 - *p0 );
-  const auto intercept = float( std::distance( input.begin(), p0 ) ) - tangent * *p0;
+  const auto intercept = float( std::distance( input, p0 ) ) - tangent * *p0;
   const int delay_pos = std::max( int( intercept ), 0 );
-  std::vector< float > attack( input.size(), 0 );
-  min_grad = 1.f/tangent;
-  for( size_t i = 0u; i != release_pos - delay_pos; ++i ) {
-    min_grad = std::min( min_grad, std::max( 0.f, grad[ i + delay_pos ] ) );
-    attack[ i + delay_pos ] = min_grad * ( 2.f * a * i + b );
+  float min_grad = 1.f/tangent;
+  float max_attack = 0.f;
+  size_t attack_pos = 0u;
+  for( size_t i = 0u; i != size; ++i ) {
+    float attack = 0.f;
+    if( ptrdiff_t( i ) >= delay_pos && ptrdiff_t( i ) < release_pos ) {
+      min_grad = std::min( min_grad, std::max( 0.f, get_grad( input, i, a, b ) ) );
+      attack = min_grad * ( 2.f * a * ( i - delay_pos ) + b );
+    }
+    if( i == 0u ) max_attack = attack;
+    else if( max_attack < attack ) {
+      max_attack = attack;
+      attack_pos = i;
+    }
   }
-  const auto attack_pos = std::distance( attack.begin(), std::max_element( attack.begin(), attack.end() ) );
-//  std::cout << "d : " << delay_pos << " a : " << attack_pos << " r : " << release_pos << std::endl;
   return std::make_tuple( std::max( 0, int( delay_pos ) ), std::max( 0, int( attack_pos ) ), std::max( 0, int( release_pos ) ) );
 }
 
+std::tuple< int, int, int > segment_envelope( const std::vector< float > &input, float a, float b ) {
+  return segment_envelope( input.data(), input.size(), a, b );
+}
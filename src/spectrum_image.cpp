@@ -10,6 +10,7 @@
 
 #include "common.hpp"
 #include "fft.hpp"
+#include "log_level.hpp"
 #include "spectrum_image.hpp"
 #include "segment_envelope.hpp"
 
@@ -21,11 +22,16 @@ spectrum_image::spectrum_image(
   uint32_t resolution_,
   uint32_t scale_,
   int weight,
-  unsigned int interval
+  unsigned int interval,
+  bool quantized,
+  size_t band_count,
+  tinyfm3::band_scale band,
+  tinyfm3::pixel_precision precision
 ) : x( x_ ), resolution( resolution_ ), scale( scale_ ), sample_rate( sample_rate_ ) {
   a = powf( 2.f, float( scale ) + weight );
   b = float( interval ) * float( scale );
-  const auto converted = fftref( window, audio, resolution, a, b, x );
+  frames = tinyfm3::frame_table( resolution, a, b, audio.size() );
+  const auto converted = fftref( window, frames, audio, x );
   pixels_begin = converted.second.get();
   pixels = converted.second;
   envelope = std::move( converted.first );
@@ -38,6 +44,27 @@ spectrum_image::spectrum_image(
   const auto tail_blank_size = std::distance( envelope.rbegin(), tail_blank_end );
   envelope.resize( envelope.size() - tail_blank_size );
   y = envelope.size();
+  if( band_count ) {
+    bank = std::make_shared< tinyfm3::filterbank >( band, band_count, x, resolution, sample_rate );
+    bands = fftproject( pixels_begin, y, *bank );
+    if( quantized ) {
+      levels.reset( new uint8_t[ bands.size() ], []( uint8_t *p ) { delete[] p; } );
+      tinyfm3::log_level::get()( bands.data(), bands.data() + bands.size(), levels.get() );
+      bands = std::vector< float >();
+    }
+    pixels.reset();
+    pixels_begin = nullptr;
+  }
+  else if( quantized ) {
+    levels = fftquantize( pixels_begin, size_t( x ) * y );
+    pixels.reset();
+    pixels_begin = nullptr;
+  }
+  else {
+    store = fftstore( pixels_begin, y, x, precision );
+    pixels.reset();
+    pixels_begin = nullptr;
+  }
   std::tie( delay, attack, release ) = segment_envelope( envelope, a, b );
   delay_time = ( a * delay * delay + b * delay ) * tinyfm3::delta;
   attack_time = ( a * attack * attack + b * attack ) * tinyfm3::delta;
@@ -45,6 +72,34 @@ spectrum_image::spectrum_image(
   total_time = ( a * envelope.size() * envelope.size() + b * envelope.size() ) * tinyfm3::delta;
   std::cout << __FILE__ << " " << __LINE__ << " " << delay_time << " " << attack_time << " " << release_time << " " << total_time << std::endl;
 }
+spectrum_image spectrum_image::replicate() const {
+  spectrum_image copy( *this );
+  if( !store.empty() ) copy.store = fftclone( store );
+  if( levels && bank ) {
+    const size_t size = get_band_count() * size_t( y );
+    copy.levels.reset( new uint8_t[ size ], []( uint8_t *p ) { delete[] p; } );
+    std::copy( levels.get(), levels.get() + size, copy.levels.get() );
+  }
+  else if( levels ) copy.levels = fftclone_levels( levels.get(), get_band_count() * size_t( y ) );
+  if( bank ) copy.bank = std::make_shared< tinyfm3::filterbank >( *bank );
+  return copy;
+}
+static std::pair< float, std::vector< float > > compare(
+  const spectrum_image &ref,
+  const window_list_t &window,
+  const std::vector< int16_t > &audio
+) {
+  if( ref.get_filterbank() ) {
+    if( ref.is_quantized() )
+      return fftcomp_banded_quantized( ref.get_levels(), ref.get_height(), *ref.get_filterbank(), window, ref.get_frames(), audio, ref.get_width() );
+    else
+      return fftcomp_banded( ref.get_bands(), ref.get_height(), *ref.get_filterbank(), window, ref.get_frames(), audio, ref.get_width() );
+  }
+  else if( ref.is_quantized() )
+    return fftcomp_quantized( ref.get_levels(), ref.get_height(), window, ref.get_frames(), audio, ref.get_width() );
+  else
+    return fftcomp( ref.get_store(), window, ref.get_frames(), audio, ref.get_width() );
+}
 float get_distance(
   const spectrum_image &ref,
   const window_list_t &window,
@@ -52,7 +107,7 @@ float get_distance(
 ) {
   const float a = ref.get_a();
   const float b = ref.get_b();
-  const auto converted = fftcomp( ref.get_pixels(), ref.get_height(), window, audio, ref.get_resolution(), a, b, ref.get_width() );
+  const auto converted = compare( ref, window, audio );
   float delay, attack, release;
   std::tie( delay, attack, release ) = segment_envelope( converted.second, ref.get_a(), ref.get_b() );
   double delay_time = ( a * delay * delay + b * delay ) * tinyfm3::delta;
@@ -62,6 +117,6 @@ float get_distance(
   double attack_distance = std::abs( ref.get_attack_time() - attack_time );
   double release_distance = std::abs( ref.get_release_time() - release_time );
 //  std::cout << delay_distance << " " << attack_distance << " " << release_distance << std::endl;
-  return double( converted.first )/ref.get_width()/ref.get_height() * ( delay_distance * 40.f + attack_distance * 40.f + release_distance * 40.f + 1.f );
+  return double( converted.first )/ref.get_band_count()/ref.get_height() * ( delay_distance * 40.f + attack_distance * 40.f + release_distance * 40.f + 1.f );
 }
 
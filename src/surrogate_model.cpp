@@ -0,0 +1,41 @@
+#include <algorithm>
+#include <iterator>
+
+#include "surrogate_model.hpp"
+
+surrogate_model::surrogate_model( size_t dimension_, size_t capacity_, size_t neighbor_count_ ) :
+  dimension( dimension_ ), capacity( capacity_ ), neighbor_count( neighbor_count_ ), count( 0u ), head( 0u ),
+  features( dimension_ * capacity_ ), values( capacity_ ) {}
+
+void surrogate_model::add( const float *f, double value ) {
+  std::copy( f, f + dimension, std::next( features.begin(), head * dimension ) );
+  values[ head ] = value;
+  head = ( head + 1u ) % capacity;
+  count = std::min( count + 1u, capacity );
+}
+
+double surrogate_model::predict( const float *f ) const {
+  nearest.clear();
+  for( size_t i = 0u; i != count; ++i ) {
+    const float *s = features.data() + i * dimension;
+    float d = 0.f;
+    for( size_t j = 0u; j != dimension; ++j )
+      d += ( s[ j ] - f[ j ] ) * ( s[ j ] - f[ j ] );
+    nearest.emplace_back( d, i );
+  }
+  const size_t k = std::min( neighbor_count, nearest.size() );
+  std::partial_sort( nearest.begin(), std::next( nearest.begin(), k ), nearest.end() );
+  double sum = 0.0;
+  double weight_sum = 0.0;
+  for( size_t i = 0u; i != k; ++i ) {
+    const double weight = 1.0 / ( double( nearest[ i ].first ) + 1.0e-6 );
+    sum += weight * values[ nearest[ i ].second ];
+    weight_sum += weight;
+  }
+  return weight_sum != 0.0 ? sum / weight_sum : 0.0;
+}
+
+void surrogate_model::clear() {
+  count = 0u;
+  head = 0u;
+}
@@ -5,17 +5,19 @@
 #include <complex>
 #include <algorithm>
 #include <chrono>
+#include <thread>
+#include <memory>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
 #include <boost/program_options.hpp>
 #include <boost/spirit/include/karma.hpp>
 #include <boost/container/flat_map.hpp>
 #include <sndfile.h>
 #include <OpenImageIO/imageio.h>
-#ifdef ENABLE_CUDA
-#include <cufft.h>
-#include <cufftXt.h>
-#else
 #include <fftw3.h>
-#endif
+
+#include "log_level.hpp"
 
 struct fft_failed : public std::runtime_error {
   fft_failed( const std::string &what ) : std::runtime_error( what ) {}
@@ -39,172 +41,6 @@ struct fft_data_transfar_failed : public fft_failed {
   fft_data_transfar_failed( const char *what ) : fft_failed( what ) {}
 };
 
-#ifdef ENABLE_CUDA
-
-#define checkCudaErrors( expr, exception ) \
-{ \
-  auto cuda_result = expr; \
-  if( cuda_result != cudaSuccess ) \
-    throw exception ( cudaGetErrorString( cudaGetLastError() ) ); \
-}
-
-#define checkCuFFTErrors( expr, exception ) \
-{ \
-  auto cuda_result = expr; \
-  if( cuda_result != CUFFT_SUCCESS ) \
-    throw exception ( cudaGetErrorString( cudaGetLastError() ) ); \
-}
-
-struct fft_detail {
-  float *window;
-  size_t resolution;
-  size_t interval;
-  size_t width;
-  float *envelope;
-};
-
-__device__ inline void atomicAdd(float* address, float value) {
-  while( ( old = atomicExch( address, atomicExch( address, 0.0f ) + old ) ) != 0.0f );
-}
-
-__device__ cufftReal input_cb(
-  void *src, 
-  size_t offset, 
-  void *callerInfo, 
-  void *sharedPtr
-) {
-  fft_detail *detail = (fft_detail*)callerInfo;
-  size_t index = offset % detail->resolution;
-  size_t batch = offset / detail->resolution;
-  int16_t element = ((int16_t*)src)[ index + batch * detail->interval ];
-  return ( cufftReal )( element/32767.f * detail->window[ index ] );
-}
-
-__device__ void output_cb(
-  void *dataOut, 
-  size_t offset, 
-  cufftComplex element, 
-  void *callerInfo, 
-  void *sharedPtr
-) {
-  fft_detail *detail = (fft_detail*)callerInfo;
-  size_t index = offset % ( (detail->resolution/2) + 1 );
-  size_t batch = offset / ( (detail->resolution/2) + 1 );
-  if( index < detail->width ) {
-    float abs = cuCabsf( element );
-    atomicAdd( detail->envelope + detail->width * batch, abs );
-    ( (float*)dataOut )[ index + detail->width * batch ] = abs;
-  }
-}
-
-__device__ cufftCallbackLoadR input_cb_ptr_d = input_cb; 
-__device__ cufftCallbackStoreC output_cb_ptr_d = output_cb;
-
-__global__ void generate_window( fft_detail *detail ) {
-  size_t index = threadIdx.x + blockIdx.x * 1024;
-  detail->window[ index ] = sinf( float( M_PI ) * float( index ) / detail->resolution ); 
-}
-
-__global__ void generate_window( float *window, unsigned int resolution ) {
-  size_t index = threadIdx.x + blockIdx.x * 1024;
-  window[ index ] = sinf( float( M_PI ) * float( index ) / resolution ); 
-}
-
-using window_list_t = boost::container::flat_map< unsigned int, std::shared_ptr< float > >;
-
-window_list_t generate_window() {
-  window_list_t result;
-  for( unsigned int i = 16u; i != 65536u; i <<= 1 ) {
-    float *window;
-    checkCudaErrors( cudaMalloc( &window, sizeof(float)*i ), fft_allocation_failed );
-    std::shared_ptr< float > wrapped( window, &cudaFree );
-    if( i > 1024 ) generate_window<<< i/1024, 1024 >>>( window, i );
-    else generate_window<<< 1, i >>>( window, i );
-    result.insert( result.end(), std::make_pair( i, wrapped ) );
-  }
-  checkCudaErrors( cudaDeviceSynchronize(), fft_initialization_failed );
-  return std::move( result );
-}
-
-std::vector< float > fft( const window_list_t &window, const std::vector< int16_t > &data, size_t resolution, size_t interval, size_t width ) {
-  const auto window_iter = window.find( resolution );
-  if( window_iter == window.end() ) throw fft_initialization_failed( "invalid resolution" );
-  const size_t batch = ( data.size() - resolution )/interval + 1;
-  int16_t *envelope;
-  checkCudaErrors(cudaMalloc( &envelope, sizeof(float)*batch), fft_allocation_failed );
-  std::shared_ptr< float > wrapped_envelope( envelope, &cudaFree );
-  checkCudaErrors( cudaMemset( envelope, 0, batch * sizeof(float) ), fft_initialization_failed );
-  fft_detail *detail;
-  checkCudaErrors(cudaMallocManaged( &detail, sizeof(fft_detail),cudaMemAttachGlobal), fft_allocation_failed );
-  std::shared_ptr< fft_detail > wrapped_detail( detail, &cudaFree );
-  detail->resolution = resolution;
-  detail->interval = interval;
-  detail->width = width;
-  detail->window = window_iter->second.get();
-  detail->envelope = envelope;
-  int16_t *input;
-  checkCudaErrors(cudaMalloc( &input, sizeof(int16_t)*data.size()), fft_allocation_failed );
-  std::shared_ptr< int16_t > wrapped_input( input, &cudaFree );
-  checkCudaErrors(cudaMemcpy( input, data.data(), sizeof(int16_t)*data.size(), cudaMemcpyHostToDevice ), fft_data_transfar_failed );
-  float *output;
-  checkCudaErrors(cudaMalloc( &output, sizeof(float)*width*batch), fft_allocation_failed );
-  std::shared_ptr< float > wrapped_output( output, &cudaFree );
-  cufftHandle plan;
-  checkCuFFTErrors( cufftCreate( &plan ), fft_initialization_failed );
-  int signal_size = resolution;
-  size_t work_size;
-  checkCuFFTErrors( cufftMakePlanMany( plan, 1, &signal_size, 0, 0, 0, 0, 0, 0, CUFFT_R2C, batch, &work_size ), fft_initialization_failed );
-  cufftCallbackLoadR input_cb_ptr_h;
-  checkCudaErrors( cudaMemcpyFromSymbol( &input_cb_ptr_h, input_cb_ptr_d, sizeof( cufftCallbackLoadR ) ), fft_data_transfar_failed );
-  cufftCallbackStoreC output_cb_ptr_h;
-  checkCudaErrors( cudaMemcpyFromSymbol( &output_cb_ptr_h, output_cb_ptr_d, sizeof( cufftCallbackStoreC ) ), fft_data_transfar_failed );
-  checkCuFFTErrors( cufftXtSetCallback( plan, (void **)&input_cb_ptr_h, CUFFT_CB_LD_REAL, (void **)&detail ), fft_initialization_failed );
-  checkCuFFTErrors( cufftXtSetCallback( plan, (void **)&output_cb_ptr_h, CUFFT_CB_ST_COMPLEX, (void **)&detail ), fft_initialization_failed );
-  checkCuFFTErrors( cufftExecR2C( plan, (cufftReal*)input, (cufftComplex *)output ), fft_execution_failed );
-  std::vector< float > result( width*batch );
-  checkCudaErrors( cudaDeviceSynchronize(), fft_execution_failed );
-  checkCudaErrors(cudaMemcpy( result.data(), output, sizeof(float)*width*batch, cudaMemcpyDeviceToHost ),fft_data_transfar_failed);
-  return std::move( result );
-}
-#else
-using window_list_t = boost::container::flat_map< unsigned int, std::vector< float > >;
-
-window_list_t generate_window() {
-  window_list_t result;
-  for( unsigned int i = 16u; i != 65536u; i <<= 1 ) {
-    float *window;
-    std::vector< float > w( i );
-    for( unsigned int j = 0u; j != i; ++j )
-      w[ j ] = sinf( float( M_PI ) * float( j ) / i );
-    result.insert( result.end(), std::make_pair( i, std::move( w ) ) );
-  }
-  return std::move( result );
-}
-
-std::vector< float > fft( const window_list_t &window, const std::vector< int16_t > &data, size_t resolution, size_t interval, size_t width ) {
-  const auto window_iter = window.find( resolution );
-  if( window_iter == window.end() ) throw fft_initialization_failed( "invalid resolution" );
-  const size_t batch = ( data.size() - resolution )/interval + 1;
-  std::shared_ptr< float > input( (float*)fftwf_malloc(sizeof(float)*resolution), &fftwf_free );
-  if( !input ) throw fft_allocation_failed( "unable to allocate memory for input" );
-  std::shared_ptr< fftwf_complex > output( (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*resolution), &fftwf_free );
-  if( !output ) throw fft_allocation_failed( "unable to allocate memory for output" );
-  std::vector< float > result;
-  fftwf_plan plan = fftwf_plan_dft_r2c_1d( resolution, input.get(), output.get(), FFTW_ESTIMATE );
-  if( !plan ) fft_initialization_failed( "unable to create the plan" );
-  for( size_t current_batch = 0u; current_batch != batch; ++current_batch ) {
-    for( size_t i = 0u; i != resolution; ++i )
-      input.get()[ i ] = data[ i + current_batch * interval ]/32767.f * window_iter->second[ i ];
-    fftwf_execute( plan );
-    for( size_t i = 0u; i != width; ++i )
-      result.push_back( std::abs( std::complex< float >( output.get()[ i ][ 0 ], output.get()[ i ][ 1 ] ) ) );
-  }
-  fftwf_destroy_plan( plan );
-  return std::move( result );
-}
-
-#endif
-
 float accumulate( const std::vector< float > &input, int x, float kp, const std::vector< std::tuple< int, float > > &window ) {
   float sum = std::accumulate(
     window.begin(), window.end(), 0.f,
@@ -263,142 +99,319 @@ float tri( float x ) {
   else return 4.f*x-4.f;
 }
 
-std::vector< int16_t > load_monoral( const std::string &filename, bool norm ) {
-  SF_INFO info;
+using window_list_t = boost::container::flat_map< unsigned int, std::vector< float > >;
+
+window_list_t generate_window() {
+  window_list_t result;
+  for( unsigned int i = 16u; i != 65536u; i <<= 1 ) {
+    std::vector< float > w( i );
+    for( unsigned int j = 0u; j != i; ++j )
+      w[ j ] = sinf( float( M_PI ) * float( j ) / i );
+    result.insert( result.end(), std::make_pair( i, std::move( w ) ) );
+  }
+  return result;
+}
+
+struct audio_stats {
+  int channels;
+  sf_count_t offset;
+  sf_count_t length;
+  float gain;
+};
+
+SNDFILE *open_audio( const std::string &filename, SF_INFO &info ) {
   info.frames = 0;
   info.samplerate = 0;
   info.channels = 0;
   info.format = 0;
   info.sections = 0;
   info.seekable = 0;
-  std::cout << filename << std::endl;
   auto audio_file = sf_open( filename.c_str(), SFM_READ, &info );
-  if( !audio_file ) {
+  if( !audio_file || info.channels <= 0 ) {
+    if( audio_file ) sf_close( audio_file );
     std::cerr << "Unable to open audio file" << std::endl;
     throw -1;
   }
-  std::vector< int16_t > monoral;
-  std::vector< int16_t > multi_channel;
-  multi_channel.resize( info.frames * info.channels );
-  const auto read_count = sf_read_short( audio_file, multi_channel.data(), info.frames * info.channels );
-  if( read_count == 0u ) {
-    std::cerr << "Unable to read audio file" << std::endl;
-    throw -1;
+  return audio_file;
+}
+
+void downmix( const float *input, float *output, size_t frames, int channels, float gain ) {
+  const float scale = gain / channels;
+  for( size_t i = 0u; i != frames; ++i ) {
+    float sum = 0.f;
+    for( int c = 0; c != channels; ++c )
+      sum += input[ i * channels + c ];
+    output[ i ] = sum * scale;
+  }
+}
+
+bool is_audible( float v ) {
+  return std::fabs( v ) * 32768.f >= 1.f;
+}
+
+audio_stats scan_audio( const std::string &filename, bool norm ) {
+  SF_INFO info;
+  auto audio_file = open_audio( filename, info );
+  constexpr sf_count_t chunk_frames = 4096;
+  std::vector< float > chunk( chunk_frames * info.channels );
+  std::vector< float > mixed( chunk_frames );
+  audio_stats stats{ info.channels, -1, 0, 1.f };
+  sf_count_t position = 0;
+  sf_count_t last = -1;
+  float peak = 0.f;
+  while( 1 ) {
+    const auto read_count = sf_readf_float( audio_file, chunk.data(), chunk_frames );
+    if( read_count <= 0 ) break;
+    downmix( chunk.data(), mixed.data(), read_count, info.channels, 1.f );
+    for( sf_count_t i = 0; i != read_count; ++i ) {
+      if( is_audible( mixed[ i ] ) ) {
+        if( stats.offset < 0 ) stats.offset = position + i;
+        last = position + i;
+        peak = std::max( peak, std::fabs( mixed[ i ] ) );
+      }
+    }
+    position += read_count;
   }
   sf_close( audio_file );
-  if( read_count % info.channels != 0 ) {
-    std::cerr << "Invalid audio file" << std::endl;
+  if( position == 0 ) {
+    std::cerr << "Unable to read audio file" << std::endl;
     throw -1;
   }
-  multi_channel.resize( read_count );
-  monoral.reserve( read_count / info.channels );
-  for( auto iter = multi_channel.begin(); iter != multi_channel.end(); ) {
-    auto next_iter = std::next( iter, info.channels );
-    monoral.emplace_back( std::accumulate( iter, next_iter, int16_t( 0 ) ) / info.channels );
-    iter = next_iter;
+  if( stats.offset < 0 ) stats.offset = 0;
+  stats.length = last + 1 - stats.offset;
+  if( norm && peak != 0.f ) stats.gain = 1.f / peak;
+  return stats;
+}
+
+class audio_reader {
+public:
+  audio_reader( const std::string &filename, const audio_stats &stats_ ) : stats( stats_ ) {
+    SF_INFO info;
+    audio_file = open_audio( filename, info );
+  }
+  audio_reader( const audio_reader& ) = delete;
+  audio_reader &operator=( const audio_reader& ) = delete;
+  ~audio_reader() {
+    sf_close( audio_file );
+  }
+  void operator()( size_t begin, size_t count, float *dest ) {
+    std::fill( dest, std::next( dest, count ), 0.f );
+    if( begin >= size_t( stats.length ) ) return;
+    const size_t available = std::min( count, size_t( stats.length ) - begin );
+    if( sf_seek( audio_file, stats.offset + begin, SEEK_SET ) < 0 ) return;
+    multi_channel.resize( available * stats.channels );
+    const auto read_count = sf_readf_float( audio_file, multi_channel.data(), available );
+    if( read_count > 0 )
+      downmix( multi_channel.data(), dest, read_count, stats.channels, stats.gain );
+  }
+private:
+  audio_stats stats;
+  SNDFILE *audio_file;
+  std::vector< float > multi_channel;
+};
+
+class spectrum_worker {
+public:
+  spectrum_worker( const std::string &filename, const audio_stats &stats, const std::vector< float > &window_, size_t width_ ) :
+    reader( filename, stats ), window( window_ ), width( width_ ),
+    input( fftwf_alloc_real( window.size() ), &fftwf_free ),
+    output( fftwf_alloc_complex( window.size() / 2u + 1u ), &fftwf_free ) {
+    if( !input || !output ) throw fft_allocation_failed( "unable to allocate memory for fft" );
+    plan = fftwf_plan_dft_r2c_1d( window.size(), input.get(), output.get(), FFTW_ESTIMATE );
+    if( !plan ) throw fft_initialization_failed( "unable to create the plan" );
+  }
+  spectrum_worker( const spectrum_worker& ) = delete;
+  spectrum_worker &operator=( const spectrum_worker& ) = delete;
+  ~spectrum_worker() {
+    fftwf_destroy_plan( plan );
   }
-  const auto audio_begin = std::find_if( monoral.begin(), monoral.end(), []( int16_t v ) { return v != 0; } );
-  std::cout << std::distance( monoral.begin(), audio_begin ) << std::endl;
-  monoral.erase( monoral.begin(), audio_begin );
-  const auto max_iter = std::max_element( monoral.begin(), monoral.end() );
-  const auto min_iter = std::min_element( monoral.begin(), monoral.end() );
-  const int16_t max =
-    std::max(
-      ( max_iter != monoral.end() ) ? std::abs( *max_iter ) : int16_t( 0 ),
-      ( min_iter != monoral.end() ) ? std::abs( *min_iter ) : int16_t( 0 )
-    );
-  if( norm ) {
-    if( max != 0 ) {
-      for( auto &elem: monoral )
-        elem = int32_t( elem ) * 32768 / max;
+  void operator()( size_t row_begin, size_t row_end, size_t hop, float *magnitude ) {
+    const size_t resolution = window.size();
+    audio.resize( ( row_end - row_begin - 1u ) * hop + resolution );
+    reader( row_begin * hop, audio.size(), audio.data() );
+    for( size_t row = row_begin; row != row_end; ++row ) {
+      const float *frame = std::next( audio.data(), ( row - row_begin ) * hop );
+      for( size_t i = 0u; i != resolution; ++i )
+        input.get()[ i ] = frame[ i ] * window[ i ];
+      fftwf_execute( plan );
+      for( size_t i = 0u; i != width; ++i, ++magnitude )
+        *magnitude = std::abs( std::complex< float >( output.get()[ i ][ 0 ], output.get()[ i ][ 1 ] ) );
     }
   }
-  return monoral;
-}
+private:
+  audio_reader reader;
+  const std::vector< float > &window;
+  size_t width;
+  std::unique_ptr< float, void(*)( void* ) > input;
+  std::unique_ptr< fftwf_complex, void(*)( void* ) > output;
+  fftwf_plan plan;
+  std::vector< float > audio;
+};
 
-struct spectrum_image {
-  spectrum_image(
-    const window_list_t &window,
-    const std::vector< int16_t > &audio,
-    int x_,
-    uint8_t note,
-    unsigned int sample_rate_,
-    uint32_t resolution_,
-    uint32_t interval_,
-    bool delayed
-  ) : x( x_ ), resolution( resolution_ ), interval( interval_ ), sample_rate( sample_rate_ ) {
-    y = audio.size() / ( sample_rate / interval );
-    const int channels = 3;
-    pixels.reserve( x * y * channels );
-    const float freq = exp2f( ( ( float( note ) +  3.f ) / 12.f ) ) * 6.875f;
-    std::vector< uint32_t > harmonic;
-    for( size_t i = 0u; i != 16u; ++ i ) {
-      harmonic.emplace_back( ceilf( freq * std::pow( 2.f, float( i ) ) * float( resolution ) * 2.f /float( sample_rate ) ) );
+struct spectrum_settings {
+  int x;
+  uint8_t note;
+  unsigned int sample_rate;
+  uint32_t resolution;
+  uint32_t interval;
+  unsigned int jobs;
+  size_t tile;
+};
+
+int write_spectrum(
+  const window_list_t &windows,
+  const tinyfm3::log_level &lut,
+  const std::string &input_filename,
+  const std::string &output_filename,
+  const std::string &envelope_filename,
+  const spectrum_settings &settings
+) {
+  const auto window_iter = windows.find( settings.resolution );
+  if( window_iter == windows.end() ) throw fft_initialization_failed( "invalid resolution" );
+  std::cout << input_filename << std::endl;
+  const auto stats = scan_audio( input_filename, true );
+  const size_t x = settings.x;
+  const size_t hop = settings.sample_rate / settings.interval;
+  const size_t row_count = ( size_t( stats.length ) + hop - 1u ) / hop;
+  const float freq = exp2f( ( ( float( settings.note ) +  3.f ) / 12.f ) ) * 6.875f;
+  std::vector< uint32_t > harmonic;
+  for( size_t i = 0u; i != 16u; ++ i ) {
+    harmonic.emplace_back( ceilf( freq * std::pow( 2.f, float( i ) ) * float( settings.resolution ) * 2.f /float( settings.sample_rate ) ) );
+  }
+  const uint32_t base = harmonic.front();
+  std::cout << "base : " << base << std::endl;
+  const unsigned int jobs = std::max( settings.jobs, 1u );
+  const size_t tile = std::max( settings.tile, size_t( 1u ) );
+  std::vector< std::unique_ptr< spectrum_worker > > workers;
+  for( unsigned int i = 0u; i != jobs; ++i )
+    workers.emplace_back( new spectrum_worker( input_filename, stats, window_iter->second, x ) );
+  std::vector< float > magnitude( x );
+  size_t skip = 0u;
+  if( x > base ) {
+    for( ; skip != row_count; ++skip ) {
+      ( *workers.front() )( skip, skip + 1u, hop, magnitude.data() );
+      if( magnitude[ base ] != 0 ) break;
     }
-    uint32_t base = harmonic.front();
-    std::cout << "base : " << base << std::endl;
-    size_t offset = 0;
-    size_t y_pos = 0;
-    size_t mute_since = 0;
-    const auto converted = fft( window, audio, resolution, sample_rate/interval, x );
-    const auto begin_date = std::chrono::high_resolution_clock::now();
-    for( auto iter = converted.begin(); iter != converted.end(); iter += x ) {
-      auto end = std::next( iter, x );
-      if( !delayed || ( x > base && *std::next( iter, base ) != 0 ) ) {
-        delayed = false;
-        auto harmonic_iter = harmonic.begin();
-        size_t x_pos = 0;
-        for( const auto &l : boost::make_iterator_range( iter, std::next( iter, x ) ) ) {
-          const auto p = uint8_t( std::min( std::max( 80.f * std::log10( std::max( l, 1.f ) ), 0.f ), 255.f ) );
-          if( *harmonic_iter == x_pos ) {
-            pixels.emplace_back( 128 + p / 2 );
-            pixels.emplace_back( p );
-            pixels.emplace_back( p );
-            ++harmonic_iter;
-          }
-          else if( y_pos % interval == 0 ) {
-            pixels.emplace_back( 128 + p / 2 );
-            pixels.emplace_back( p );
-            pixels.emplace_back( p );
-          }
-          else {
-            pixels.emplace_back( p );
-            pixels.emplace_back( p );
-            pixels.emplace_back( p );
+  }
+  const size_t y = row_count - skip;
+  if( y == 0u ) {
+    std::cerr << "No audible frame" << std::endl;
+    return -1;
+  }
+  const int channels = 3;
+  using namespace OIIO_NAMESPACE;
+  ImageOutput *out = ImageOutput::create( output_filename );
+  if ( !out ) {
+    std::cerr << "Unable to open output file" << std::endl;
+    return -1;
+  }
+  ImageSpec spec ( x, y, channels, TypeDesc::UINT8 );
+  if( !out->open( output_filename, spec ) ) {
+    std::cerr << "Unable to open output file" << std::endl;
+    ImageOutput::destroy( out );
+    return -1;
+  }
+  std::vector< float > envelope( y );
+  std::vector< std::vector< float > > magnitudes( jobs, std::vector< float >( x * tile ) );
+  std::vector< std::vector< uint8_t > > pixels( jobs, std::vector< uint8_t >( x * tile * channels ) );
+  const auto begin_date = std::chrono::high_resolution_clock::now();
+  for( size_t wave_begin = 0u; wave_begin < y; wave_begin += tile * jobs ) {
+    std::vector< std::thread > threads;
+    for( unsigned int t = 0u; t != jobs; ++t ) {
+      const size_t row_begin = wave_begin + t * tile;
+      if( row_begin >= y ) break;
+      const size_t row_end = std::min( row_begin + tile, y );
+      threads.emplace_back( [&,t,row_begin,row_end]() {
+        ( *workers[ t ] )( row_begin + skip, row_end + skip, hop, magnitudes[ t ].data() );
+        auto m = magnitudes[ t ].begin();
+        auto p = pixels[ t ].begin();
+        for( size_t y_pos = row_begin; y_pos != row_end; ++y_pos ) {
+          envelope[ y_pos ] = std::accumulate( m, std::next( m, x ), 0.f );
+          auto harmonic_iter = harmonic.begin();
+          for( size_t x_pos = 0u; x_pos != x; ++x_pos, ++m ) {
+            const auto l = lut( *m );
+            if( harmonic_iter != harmonic.end() && *harmonic_iter == x_pos ) {
+              *p++ = 128 + l / 2;
+              ++harmonic_iter;
+            }
+            else if( y_pos % settings.interval == 0 ) *p++ = 128 + l / 2;
+            else *p++ = l;
+            *p++ = l;
+            *p++ = l;
           }
-          ++x_pos;
         }
-        envelope.emplace_back( std::accumulate( iter, end, 0.f ) );
-        ++y_pos;
-        if( std::find_if( iter, end, []( float v ) { return v != 0; } ) != end ) mute_since = y_pos;
+      } );
+    }
+    for( auto &thread: threads ) thread.join();
+    for( unsigned int t = 0u; t != threads.size(); ++t ) {
+      const size_t row_begin = wave_begin + t * tile;
+      const size_t row_end = std::min( row_begin + tile, y );
+      if( !out->write_scanlines( row_begin, row_end, 0, TypeDesc::UINT8, pixels[ t ].data() ) ) {
+        std::cerr << "Unable to write output file" << std::endl;
+        out->close();
+        ImageOutput::destroy( out );
+        return -1;
       }
-      else --y;
     }
-    const auto end_date = std::chrono::high_resolution_clock::now();
-    std::cout << "Elapsed: " << std::chrono::duration_cast< std::chrono::microseconds >( end_date - begin_date ).count() << "us" << std::endl;
-    pixels.resize( x * mute_since * channels );
   }
-  std::vector< float > envelope;
-  std::vector< uint8_t > pixels;
-  int x;
-  int y;
-  uint32_t resolution;
-  uint32_t interval;
-  uint32_t sample_rate;
-};
+  const auto end_date = std::chrono::high_resolution_clock::now();
+  std::cout << "Elapsed: " << std::chrono::duration_cast< std::chrono::microseconds >( end_date - begin_date ).count() << "us" << std::endl;
+  out->close();
+  ImageOutput::destroy( out );
+
+  std::fstream envelope_file( envelope_filename, std::ios::out );
+  for( size_t i = 0u; i != envelope.size(); ++i ) {
+    std::string line;
+    namespace karma = boost::spirit::karma;
+    karma::generate( std::back_inserter( line ), karma::float_ << '\t' << karma::float_ << karma::eol, boost::fusion::make_vector( float( i )/settings.interval, envelope[ i ] ) );
+    envelope_file.write( line.c_str(), line.size() );
+  }
+  envelope_file.close();
+  const auto grad = segment_envelope( envelope, settings.interval );
+  std::cout << "delay : " << std::get< 0 >( grad )/float( settings.interval ) << std::endl;
+  std::cout << "attack : " << std::get< 1 >( grad )/float( settings.interval ) << std::endl;
+  std::cout << "release : " << std::get< 2 >( grad )/float( settings.interval ) << std::endl;
+  return 0;
+}
 
+bool is_directory( const std::string &path ) {
+  struct stat buf;
+  return stat( path.c_str(), &buf ) == 0 && S_ISDIR( buf.st_mode );
+}
+
+std::vector< std::string > list_files( const std::string &path ) {
+  std::vector< std::string > files;
+  DIR *dir = opendir( path.c_str() );
+  if( !dir ) return files;
+  while( const auto entry = readdir( dir ) ) {
+    const std::string name = entry->d_name;
+    if( name.empty() || name[ 0 ] == '.' ) continue;
+    if( !is_directory( path + "/" + name ) ) files.push_back( name );
+  }
+  closedir( dir );
+  std::sort( files.begin(), files.end() );
+  return files;
+}
+
+std::string get_stem( const std::string &name ) {
+  const auto dot = name.rfind( '.' );
+  return ( dot == std::string::npos || dot == 0u ) ? name : name.substr( 0u, dot );
+}
 
 int main( int argc, char* argv[] ) {
   boost::program_options::options_description options("オプション");
   options.add_options()
     ("help,h",    "ヘルプを表示")
-    ("input,i", boost::program_options::value<std::string>(),  "入力ファイル")
-    ("output,o", boost::program_options::value<std::string>(),  "出力ファイル")
-    ("envelope,e", boost::program_options::value<std::string>(),  "エンベロープ")
+    ("input,i", boost::program_options::value<std::string>(),  "入力ファイル (ディレクトリを指定すると中の全てのファイルを変換)")
+    ("output,o", boost::program_options::value<std::string>(),  "出力ファイル (入力がディレクトリの場合は出力先ディレクトリ)")
+    ("envelope,e", boost::program_options::value<std::string>(),  "エンベロープ (入力がディレクトリの場合は出力先ディレクトリ)")
+    ("extension,x", boost::program_options::value<std::string>()->default_value(".png"),  "ディレクトリ変換時の画像の拡張子")
     ("note,n", boost::program_options::value<int>()->default_value(60),  "音階")
     ("width,w", boost::program_options::value<int>()->default_value(1024),  "幅")
     ("resolution,r", boost::program_options::value<int>()->default_value(13),  "分解能")
-    ("interval,j", boost::program_options::value<int>()->default_value(100),  "間隔");
+    ("interval,j", boost::program_options::value<int>()->default_value(100),  "間隔")
+    ("jobs,p", boost::program_options::value<unsigned int>()->default_value(std::max(std::thread::hardware_concurrency(),1u)),  "スレッド数")
+    ("tile,t", boost::program_options::value<size_t>()->default_value(64u),  "1スレッドが一度に処理する行数");
   boost::program_options::variables_map params;
   boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
   boost::program_options::notify( params );
@@ -408,36 +421,36 @@ int main( int argc, char* argv[] ) {
   }
   const std::string input_filename = params["input"].as<std::string>();
   const std::string output_filename = params["output"].as<std::string>();
-  const auto audio = load_monoral( input_filename, true );
-  const int x = params["width"].as<int>();
-  const auto window = generate_window();
-  const spectrum_image image( window, audio, x, params["note"].as<int>(), 44100, 1 << params["resolution"].as<int>(), params["interval"].as<int>(), true );
-  const int channels = 3;
-  using namespace OIIO_NAMESPACE;
-  ImageOutput *out = ImageOutput::create( output_filename );
-  if ( !out ) {
-    std::cerr << "Unable to open output file" << std::endl;
+  const std::string envelope_filename = params["envelope"].as<std::string>();
+  spectrum_settings settings;
+  settings.x = params["width"].as<int>();
+  settings.note = params["note"].as<int>();
+  settings.sample_rate = 44100;
+  settings.resolution = 1 << params["resolution"].as<int>();
+  settings.interval = params["interval"].as<int>();
+  settings.jobs = params["jobs"].as<unsigned int>();
+  settings.tile = params["tile"].as<size_t>();
+  if( settings.x <= 0 || settings.interval <= 0 || settings.interval > settings.sample_rate || size_t( settings.x ) > settings.resolution / 2u + 1u ) {
+    std::cerr << "Invalid width or interval" << std::endl;
     return -1;
   }
-  ImageSpec spec ( image.x, image.y, channels, TypeDesc::UINT8);
-  out->open( output_filename, spec );
-  out->write_image( TypeDesc::UINT8, image.pixels.data() );
- out->close();
-
-  std::fstream envelope_file( params["envelope"].as<std::string>(), std::ios::out );
-  for( int i = 0; i != image.envelope.size(); ++i ) {
-    std::string line;
-    namespace karma = boost::spirit::karma;
-    karma::generate( std::back_inserter( line ), karma::float_ << '\t' << karma::float_ << karma::eol, boost::fusion::make_vector( float( i )/image.interval, image.envelope[ i ] ) );
-    envelope_file.write( line.c_str(), line.size() );
+  const auto window = generate_window();
+  const auto &lut = tinyfm3::log_level::get();
+  if( !is_directory( input_filename ) )
+    return write_spectrum( window, lut, input_filename, output_filename, envelope_filename, settings );
+  mkdir( output_filename.c_str(), 0755 );
+  mkdir( envelope_filename.c_str(), 0755 );
+  int result = 0;
+  for( const auto &name: list_files( input_filename ) ) {
+    const auto stem = get_stem( name );
+    try {
+      if( write_spectrum( window, lut, input_filename + "/" + name, output_filename + "/" + stem + params["extension"].as<std::string>(), envelope_filename + "/" + stem + ".txt", settings ) )
+        result = -1;
+    }
+    catch( ... ) {
+      std::cerr << "Skipped " << name << std::endl;
+      result = -1;
+    }
   }
-  envelope_file.close();
-  const auto grad = segment_envelope( image.envelope, image.interval );
-  std::cout << "delay : " << std::get< 0 >( grad )/float( image.interval ) << std::endl;
-  std::cout << "attack : " << std::get< 1 >( grad )/float( image.interval ) << std::endl;
-  std::cout << "release : " << std::get< 2 >( grad )/float( image.interval ) << std::endl;
-//  for( size_t i = 0; i != grad.size(); ++i )
-//    std::cout << i * 0.01f << " " << grad[ i ] << " " << image.envelope[ i ] << std::endl;
-//  ImageOutput::destroy( out );
+  return result;
 }
-